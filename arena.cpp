@@ -0,0 +1,50 @@
+#include "arena.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace fl {
+
+Arena::~Arena() {
+  for (char* chunk : chunks) {
+    std::free(chunk);
+  }
+}
+
+StringRef Arena::copyString(StringRef str) {
+  char* copy = static_cast<char*>(allocate(str.length, 1));
+  std::memcpy(copy, str.data, str.length);
+  return StringRef{copy, str.length};
+}
+
+void Arena::adopt(Arena* other) {
+  chunks.insert(chunks.end(), other->chunks.begin(), other->chunks.end());
+  other->chunks.clear();
+  allocatedBytes += other->allocatedBytes;
+  other->allocatedBytes = 0;
+  other->cursor = nullptr;
+  other->limit = nullptr;
+}
+
+void* Arena::allocateSlow(usize size, usize align) {
+  // malloc'd memory is suitably aligned for any fundamental type, which is all
+  // the arena supports.
+  assert(align <= alignof(long double));
+
+  // Give big allocations their own chunk so they don't waste the rest of the
+  // current one.
+  if (size > kChunkSize / 4) {
+    char* chunk = static_cast<char*>(std::malloc(size));
+    chunks.push_back(chunk);
+    allocatedBytes += size;
+    return chunk;
+  }
+
+  char* chunk = static_cast<char*>(std::malloc(kChunkSize));
+  chunks.push_back(chunk);
+  allocatedBytes += kChunkSize;
+  cursor = chunk;
+  limit = chunk + kChunkSize;
+  return allocate(size, align);
+}
+
+} // namespace fl
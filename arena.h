@@ -0,0 +1,76 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include "util.h"
+#include <cassert>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace fl {
+
+/*
+ * A bump-pointer allocator. Memory is carved sequentially out of large chunks
+ * and only released, all at once, when the arena is destroyed. Destructors of
+ * objects allocated in an arena are never run, so they should only own memory
+ * from the same arena (e.g. through Slice and StringRef).
+ */
+struct Arena {
+  Arena() {}
+  ~Arena();
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* allocate(usize size, usize align) {
+    assert(align != 0 && (align & (align - 1)) == 0);
+    usize address = reinterpret_cast<usize>(cursor);
+    usize padding = (align - (address & (align - 1))) & (align - 1);
+    if (padding + size > static_cast<usize>(limit - cursor)) {
+      return allocateSlow(size, align);
+    }
+    char* result = cursor + padding;
+    cursor = result + size;
+    return result;
+  }
+
+  template<typename T, typename... Args>
+  T* make(Args&&... args) {
+    return new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  template<typename T>
+  Slice<T> copyArray(const T* data, usize length) {
+    if (length == 0) { return Slice<T>(); }
+    T* copy = static_cast<T*>(allocate(sizeof(T) * length, alignof(T)));
+    for (usize i = 0; i < length; ++i) {
+      new (&copy[i]) T(data[i]);
+    }
+    return Slice<T>(copy, length);
+  }
+
+  StringRef copyString(StringRef str);
+
+  // Take ownership of all of the other arena's memory, leaving it empty.
+  // Anything allocated in it stays valid as long as this arena lives.
+  void adopt(Arena* other);
+
+  // The total size of the chunks the arena has allocated.
+  usize bytesAllocated() const { return allocatedBytes; }
+
+ private:
+  // Chunks are this big unless a single allocation needs more.
+  static const usize kChunkSize = 64 * 1024;
+
+  void* allocateSlow(usize size, usize align);
+
+  char* cursor = nullptr;
+  char* limit = nullptr;
+  std::vector<char*> chunks;
+  usize allocatedBytes = 0;
+};
+
+} // namespace fl
+
+#endif /* ARENA_H_ */
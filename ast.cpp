@@ -3,67 +3,115 @@
 namespace fl {
 namespace ast {
 
-void IntExpr::dump(std::ostream& o) const {
-  o << "Int(" << val << ")";
-}
+namespace {
 
-void VarExpr::dump(std::ostream& o) const {
-  o << "Var(" << name << ")";
-}
+struct Dumper : public ConstVisitor<Dumper> {
+  std::ostream& o;
 
-void BinOpExpr::dump(std::ostream& o) const {
-  o << "BinOp(" << name << ", " << *lhs << ", " << *rhs << ")";
-}
+  explicit Dumper(std::ostream& o) : o(o) {}
 
-void CallExpr::dump(std::ostream& o) const {
-  o << "FuncCall(func = " << *functionExpr << ", args = {";
-  for (int i = 0, len = argumentExprs.size(); i < len; ++i) {
-    if (i != 0) { o << ", "; }
-    o << *argumentExprs[i];
+  void dump(const Node* node) {
+    if (auto expr = dynCast<Expr>(node)) {
+      walkPreOrder(expr);
+    } else {
+      visit(node);
+    }
   }
-  o << "})";
-}
 
-void BlockExpr::dump(std::ostream& o) const {
-  o << "Block{";
-  for (int i = 0, len = exprs.size(); i < len; ++i) {
-    if (i != 0) { o << "; "; }
-    o << *exprs[i];
+  // Expressions print what comes before their first subexpression, and the
+  // rest is printed around the subexpressions by beforeSubexpr and
+  // afterSubexprs.
+  void visitIntExpr(const IntExpr* expr) {
+    o << "Int(" << expr->val << ")";
   }
-  o << "}";
-}
 
-void TypeName::dump(std::ostream& o) const {
-  o << "TypeName(" << name << ")";
-}
+  void visitVarExpr(const VarExpr* expr) {
+    o << "Var(" << expr->name << ")";
+  }
 
-void UnitType::dump(std::ostream& o) const {
-  o << "UnitType";
-}
+  void visitBinOpExpr(const BinOpExpr* expr) {
+    o << "BinOp(" << kBinOpNames[expr->op] << ", ";
+  }
 
-void FuncProto::dump(std::ostream& o) const {
-  o << "FuncProto(name = " << name << ", args = {";
-  for (int i = 0, len = argNames.size(); i < len; ++i) {
-    if (i != 0) { o << ", "; }
-    o << argNames[i] << ": " << *argTypes[i];
+  void visitCallExpr(const CallExpr*) {
+    o << "FuncCall(func = ";
   }
-  o << "}, returnType = " << *returnType << ")";
-}
 
-void ExternFunc::dump(std::ostream& o) const {
-  o << "ExternFunc(proto = " << proto << ")";
-}
+  void visitBlockExpr(const BlockExpr*) {
+    o << "Block{";
+  }
 
-void FuncDef::dump(std::ostream& o) const {
-  o << "FuncDef(proto = " << proto << ", body = " << *body << ")";
-}
+  void beforeSubexpr(const Expr* expr, usize i) {
+    if (i == 0) { return; }
+    switch (expr->kind) {
+      case Node::kBinOpExpr: o << ", "; break;
+      case Node::kCallExpr: o << (i == 1 ? ", args = {" : ", "); break;
+      case Node::kBlockExpr: o << "; "; break;
+      default: break;
+    }
+  }
 
-void Module::dump(std::ostream& o) const {
-  o << "Module{\n";
-  for (const auto& fn : functions) {
-    o << "  " << *fn << ";\n";
+  void afterSubexprs(const Expr* expr) {
+    switch (expr->kind) {
+      case Node::kBinOpExpr: o << ")"; break;
+      case Node::kCallExpr:
+        if (cast<CallExpr>(expr)->argumentExprs.empty()) { o << ", args = {"; }
+        o << "})";
+        break;
+      case Node::kBlockExpr: o << "}"; break;
+      default: break;
+    }
   }
-  o << "}\n";
+
+  void visitTypeName(const TypeName* type) {
+    o << "TypeName(" << type->name << ")";
+  }
+
+  void visitUnitType(const UnitType*) {
+    o << "UnitType";
+  }
+
+  void visitFuncProto(const FuncProto* proto) {
+    o << "FuncProto(name = " << proto->name << ", args = {";
+    for (usize i = 0, len = proto->argNames.size(); i < len; ++i) {
+      if (i != 0) { o << ", "; }
+      o << proto->argNames[i] << ": ";
+      visit(proto->argTypes[i]);
+    }
+    o << "}, returnType = ";
+    visit(proto->returnType);
+    o << ")";
+  }
+
+  void visitExternFunc(const ExternFunc* fn) {
+    o << "ExternFunc(proto = ";
+    visit(&fn->proto);
+    o << ")";
+  }
+
+  void visitFuncDef(const FuncDef* fn) {
+    o << "FuncDef(proto = ";
+    visit(&fn->proto);
+    o << ", body = ";
+    walkPreOrder(fn->body);
+    o << ")";
+  }
+
+  void visitModule(const Module* module) {
+    o << "Module{\n";
+    for (const Func* fn : module->functions) {
+      o << "  ";
+      visit(fn);
+      o << ";\n";
+    }
+    o << "}\n";
+  }
+};
+
+} // namespace
+
+void Node::dump(std::ostream& o) const {
+  Dumper(o).dump(this);
 }
 
 } // namespace ast
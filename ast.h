@@ -1,24 +1,61 @@
 #ifndef AST_H_
 #define AST_H_
 
-#include "codegen.h"
+#include "arena.h"
 #include "diagnostic.h"
 #include "lexer.h"
+#include "symbol.h"
+#include "types.h"
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Value.h>
+#include <cassert>
 #include <iostream>
 #include <string>
+#include <type_traits>
 #include <vector>
 #include <unordered_map>
 
 namespace fl {
 namespace ast {
 
-// Abstract base class for AST nodes providing convenience functions like debug
+// Base class for AST nodes providing convenience functions like debug
 // printing.
+//
+// Nodes are allocated in the Arena owned by their Module and are never
+// destroyed individually, so they refer to each other with plain pointers and
+// keep their lists in arena-allocated Slices.
+//
+// Nodes have no virtual functions. Each records its concrete class in `kind`,
+// and passes over the tree dispatch on it with a switch (see Visitor) and
+// test for it with isa, cast and dynCast below.
 struct Node {
-  virtual ~Node() {}
-  virtual void dump(std::ostream& o = std::cerr) const = 0;
+  // Nodes of the same group (expressions, types, functions) are contiguous,
+  // so a group's classof is a range check.
+  enum Kind : u8 {
+    kIntExpr,
+    kVarExpr,
+    kBinOpExpr,
+    kCallExpr,
+    kBlockExpr,
+    kTypeName,
+    kUnitType,
+    kFuncProto,
+    kExternFunc,
+    kFuncDef,
+    kModule,
+
+    kNumKinds
+  };
+
+  const Kind kind;
+
+  // The source the node was parsed from, set by the parser.
+  SourceRange location;
+
+  void dump(std::ostream& o = std::cerr) const;
+
+ protected:
+  explicit Node(Kind kind) : kind(kind) {}
 };
 
 inline std::ostream& operator<<(std::ostream& o, const Node& node) {
@@ -26,136 +63,395 @@ inline std::ostream& operator<<(std::ostream& o, const Node& node) {
   return o;
 }
 
-// Abstract base class for expressions.
+// Whether the node is a T (or one of its subclasses).
+template<typename T>
+bool isa(const Node* node) {
+  return T::classof(node);
+}
+
+// Downcast a node that must be a T.
+template<typename T>
+T* cast(Node* node) {
+  assert(isa<T>(node) && "cast to the wrong node kind");
+  return static_cast<T*>(node);
+}
+
+template<typename T>
+const T* cast(const Node* node) {
+  assert(isa<T>(node) && "cast to the wrong node kind");
+  return static_cast<const T*>(node);
+}
+
+// Downcast a node if it's a T, or return null.
+template<typename T>
+T* dynCast(Node* node) {
+  return isa<T>(node) ? static_cast<T*>(node) : nullptr;
+}
+
+template<typename T>
+const T* dynCast(const Node* node) {
+  return isa<T>(node) ? static_cast<const T*>(node) : nullptr;
+}
+
+// Base class for expressions.
 struct Expr : public Node {
-  virtual llvm::Value* codegen(FuncContext*) const = 0;
+  static bool classof(const Node* node) {
+    return node->kind >= kIntExpr && node->kind <= kBlockExpr;
+  }
+
+ protected:
+  explicit Expr(Kind kind) : Node(kind) {}
 };
 
 struct IntExpr : public Expr {
   i64 val;
 
-  IntExpr(i64 val) : val(val) {}
-  llvm::Value* codegen(FuncContext*) const override;
-  void dump(std::ostream& o) const override;
+  IntExpr(i64 val) : Expr(kIntExpr), val(val) {}
+
+  static bool classof(const Node* node) { return node->kind == kIntExpr; }
 };
 
 struct VarExpr : public Expr {
-  std::string name;
+  Symbol name;
+
+  // What the name refers to, filled in by resolveNames before codegen: an
+  // argument of the enclosing function, by position, or a function, by index
+  // in Module::functions.
+  enum Binding { kUnresolved, kArgument, kFunction };
+  Binding binding = kUnresolved;
+  u32 index = 0;
+
+  VarExpr(Symbol name) : Expr(kVarExpr), name(name) {}
 
-  VarExpr(std::string name) : name(std::move(name)) {}
-  llvm::Value* codegen(FuncContext*) const override;
-  void dump(std::ostream& o) const override;
+  static bool classof(const Node* node) { return node->kind == kVarExpr; }
 };
 
+enum BinOp {
+  kAdd,
+  kSub,
+  kMul,
+  kDiv,
+
+  kNumBinOps
+};
+
+const char* const kBinOpNames[kNumBinOps] = {"+", "-", "*", "/"};
+
 struct BinOpExpr : public Expr {
-  std::string name;
-  std::unique_ptr<Expr> lhs, rhs;
+  BinOp op;
+  Expr* lhs;
+  Expr* rhs;
 
-  BinOpExpr(std::string name,
-            std::unique_ptr<Expr> lhs,
-            std::unique_ptr<Expr> rhs)
-      : name(std::move(name)), lhs(std::move(lhs)), rhs(std::move(rhs)) {}
+  BinOpExpr(BinOp op, Expr* lhs, Expr* rhs)
+      : Expr(kBinOpExpr), op(op), lhs(lhs), rhs(rhs) {}
 
-  llvm::Value* codegen(FuncContext*) const override;
-  void dump(std::ostream& o) const override;
+  static bool classof(const Node* node) { return node->kind == kBinOpExpr; }
 };
 
 struct CallExpr : public Expr {
-  std::unique_ptr<Expr> functionExpr;
-  std::vector<std::unique_ptr<Expr>> argumentExprs;
+  Expr* functionExpr;
+  Slice<Expr*> argumentExprs;
 
-  CallExpr(std::unique_ptr<Expr> functionExpr,
-           std::vector<std::unique_ptr<Expr>> argumentExprs)
-      : functionExpr(std::move(functionExpr)),
-        argumentExprs(std::move(argumentExprs)) {}
+  CallExpr(Expr* functionExpr, Slice<Expr*> argumentExprs)
+      : Expr(kCallExpr),
+        functionExpr(functionExpr),
+        argumentExprs(argumentExprs) {}
 
-  llvm::Value* codegen(FuncContext*) const override;
-  void dump(std::ostream& o) const override;
+  static bool classof(const Node* node) { return node->kind == kCallExpr; }
 };
 
 struct BlockExpr : public Expr {
-  std::vector<std::unique_ptr<Expr>> exprs;
+  Slice<Expr*> exprs;
 
-  BlockExpr(std::vector<std::unique_ptr<Expr>> exprs)
-      : exprs(std::move(exprs)) {}
+  BlockExpr(Slice<Expr*> exprs) : Expr(kBlockExpr), exprs(exprs) {}
 
-  llvm::Value* codegen(FuncContext*) const override;
-  void dump(std::ostream& o) const override;
+  static bool classof(const Node* node) { return node->kind == kBlockExpr; }
 };
 
-// Abstract base class for type expressions.
+// Base class for type expressions.
 struct Type : public Node {
-  virtual ~Type() {}
+  // The type this expression denotes, filled in by resolveNames.
+  const type::Type* resolvedType = nullptr;
+
+  static bool classof(const Node* node) {
+    return node->kind >= kTypeName && node->kind <= kUnitType;
+  }
+
+ protected:
+  explicit Type(Kind kind) : Node(kind) {}
 };
 
 struct TypeName : public Type {
-  std::string name;
+  Symbol name;
 
-  TypeName(std::string name) : name(std::move(name)) {}
+  TypeName(Symbol name) : Type(kTypeName), name(name) {}
 
-  void dump(std::ostream& o) const override;
+  static bool classof(const Node* node) { return node->kind == kTypeName; }
 };
 
 struct UnitType : public Type {
-  UnitType() {}
+  UnitType() : Type(kUnitType) {}
 
-  void dump(std::ostream& o) const override;
+  static bool classof(const Node* node) { return node->kind == kUnitType; }
 };
 
 // Function prototype (name, arguments, types).
 struct FuncProto : public Node {
-  std::string name;
-  std::vector<std::string> argNames;
-  std::vector<std::unique_ptr<Type>> argTypes;
-  std::unique_ptr<Type> returnType;
-
-  FuncProto(std::string name,
-            std::vector<std::string> argNames,
-            std::vector<std::unique_ptr<Type>> argTypes,
-            std::unique_ptr<Type> returnType)
-      : name(std::move(name)),
-        argNames(std::move(argNames)),
-        argTypes(std::move(argTypes)),
-        returnType(std::move(returnType)) {}
-
-  void dump(std::ostream& o) const override;
+  Symbol name;
+  Slice<Symbol> argNames;
+  Slice<Type*> argTypes;
+  Type* returnType;
+
+  FuncProto(Symbol name,
+            Slice<Symbol> argNames,
+            Slice<Type*> argTypes,
+            Type* returnType)
+      : Node(kFuncProto),
+        name(name),
+        argNames(argNames),
+        argTypes(argTypes),
+        returnType(returnType) {}
+
+  static bool classof(const Node* node) { return node->kind == kFuncProto; }
 };
 
-// Abstract parent class for different function types (native and extern).
+// Parent class for different function types (native and extern).
 struct Func : public Node {
   FuncProto proto;
 
-  Func(FuncProto proto) : proto(std::move(proto)) {}
-  virtual ~Func() {}
-  virtual void codegen(ModuleContext*, llvm::Function*) const = 0;
+  static bool classof(const Node* node) {
+    return node->kind >= kExternFunc && node->kind <= kFuncDef;
+  }
+
+ protected:
+  Func(Kind kind, const FuncProto& proto) : Node(kind), proto(proto) {}
 };
 
 // A declaration of an external function (from ASM, C, etc).
 struct ExternFunc : public Func {
-  using Func::Func; // Inherited constructor.
-  virtual void codegen(ModuleContext*, llvm::Function*) const override {}
-  void dump(std::ostream& o) const override;
+  ExternFunc(const FuncProto& proto) : Func(kExternFunc, proto) {}
+
+  static bool classof(const Node* node) { return node->kind == kExternFunc; }
 };
 
 // A natively defined function with a body.
 struct FuncDef : public Func {
-  std::unique_ptr<Expr> body;
+  Expr* body;
+
+  FuncDef(const FuncProto& proto, Expr* body)
+      : Func(kFuncDef, proto), body(body) {}
 
-  FuncDef(FuncProto proto, std::unique_ptr<Expr> body)
-      : Func(std::move(proto)), body(std::move(body)) {}
-  virtual void codegen(ModuleContext*, llvm::Function*) const override;
-  void dump(std::ostream& o) const override;
+  static bool classof(const Node* node) { return node->kind == kFuncDef; }
 };
 
 struct Module : public Node {
-  std::vector<std::unique_ptr<Func>> functions;
+  // Owns every node of the module, including the functions below.
+  std::unique_ptr<Arena> arena;
+  std::vector<Func*> functions;
+
+  // Owns the types the module's type expressions resolve to.
+  type::TypeContext types;
+
+  Module(std::unique_ptr<Arena> arena, std::vector<Func*> functions)
+      : Node(kModule),
+        arena(std::move(arena)),
+        functions(std::move(functions)) {}
 
-  Module(std::vector<std::unique_ptr<Func>> functions)
-      : functions(std::move(functions)) {}
+  static bool classof(const Node* node) { return node->kind == kModule; }
+
+  // Generate the whole module in the global LLVM context. The module's names
+  // must have been resolved (see resolveNames).
   std::unique_ptr<llvm::Module> codegen() const;
-  void dump(std::ostream& o) const override;
+
+  // Generate a module in the given context containing the bodies of only the
+  // functions with indices in [begin, end). Other functions are declared from
+  // their prototypes where they're called, so calls across partitions still
+  // resolve.
+  std::unique_ptr<llvm::Module> codegen(llvm::LLVMContext& llcontext,
+                                        usize begin, usize end) const;
 };
 
+// The number of subexpressions of an expression, and the ith of them, in
+// source order. A call's subexpressions are the function and then the
+// arguments. The walks of Visitor are built on these, so they're the only
+// code that needs to know which subexpressions each kind of expression has.
+inline usize numSubexprs(const Expr* expr) {
+  switch (expr->kind) {
+    case Node::kBinOpExpr: return 2;
+    case Node::kCallExpr:
+      return 1 + static_cast<const CallExpr*>(expr)->argumentExprs.size();
+    case Node::kBlockExpr:
+      return static_cast<const BlockExpr*>(expr)->exprs.size();
+    default: return 0;
+  }
+}
+
+inline Expr* subexpr(const Expr* expr, usize i) {
+  assert(i < numSubexprs(expr));
+  switch (expr->kind) {
+    case Node::kBinOpExpr: {
+      auto binOp = static_cast<const BinOpExpr*>(expr);
+      return i == 0 ? binOp->lhs : binOp->rhs;
+    }
+    case Node::kCallExpr: {
+      auto call = static_cast<const CallExpr*>(expr);
+      return i == 0 ? call->functionExpr : call->argumentExprs[i - 1];
+    }
+    default:
+      return static_cast<const BlockExpr*>(expr)->exprs[i];
+  }
+}
+
+/*
+ * Dispatches on a node's kind to the visit method of Derived for its class.
+ * A visit method Derived doesn't define falls back to the one for the node's
+ * group (visitExpr, visitType or visitFunc), and those to visitNode, which
+ * returns Result(). Every call is resolved at compile time, so a pass pays
+ * for one switch per node and its visit methods can be inlined.
+ *
+ * Expressions can nest far deeper than the native stack allows (the parser
+ * builds a million-deep `a + a + ...` without recursing), so passes don't
+ * recurse into subexpressions. They walk them with walkPreOrder or
+ * walkPostOrder, which keep their own stack:
+ *
+ *   struct IntSum : Visitor<IntSum, i64> {
+ *     i64 visitIntExpr(IntExpr* expr) { return expr->val; }
+ *     i64 visitBinOpExpr(BinOpExpr*) {
+ *       return subexprResult(0) + subexprResult(1);
+ *     }
+ *   };
+ *
+ *   i64 sum = IntSum().walkPostOrder(expr);
+ *
+ * Use ConstVisitor to visit const nodes.
+ */
+template<typename Derived, typename Result = void, bool IsConst = false>
+struct Visitor {
+  template<typename T>
+  using Ptr = typename std::conditional<IsConst, const T*, T*>::type;
+
+  Result visit(Ptr<Node> node) {
+    switch (node->kind) {
+      case Node::kIntExpr:
+        return self().visitIntExpr(static_cast<Ptr<IntExpr>>(node));
+      case Node::kVarExpr:
+        return self().visitVarExpr(static_cast<Ptr<VarExpr>>(node));
+      case Node::kBinOpExpr:
+        return self().visitBinOpExpr(static_cast<Ptr<BinOpExpr>>(node));
+      case Node::kCallExpr:
+        return self().visitCallExpr(static_cast<Ptr<CallExpr>>(node));
+      case Node::kBlockExpr:
+        return self().visitBlockExpr(static_cast<Ptr<BlockExpr>>(node));
+      case Node::kTypeName:
+        return self().visitTypeName(static_cast<Ptr<TypeName>>(node));
+      case Node::kUnitType:
+        return self().visitUnitType(static_cast<Ptr<UnitType>>(node));
+      case Node::kFuncProto:
+        return self().visitFuncProto(static_cast<Ptr<FuncProto>>(node));
+      case Node::kExternFunc:
+        return self().visitExternFunc(static_cast<Ptr<ExternFunc>>(node));
+      case Node::kFuncDef:
+        return self().visitFuncDef(static_cast<Ptr<FuncDef>>(node));
+      case Node::kModule:
+        return self().visitModule(static_cast<Ptr<Module>>(node));
+      default:
+        assert(false && "unknown node kind");
+        return Result();
+    }
+  }
+
+  Result visitIntExpr(Ptr<IntExpr> node) { return self().visitExpr(node); }
+  Result visitVarExpr(Ptr<VarExpr> node) { return self().visitExpr(node); }
+  Result visitBinOpExpr(Ptr<BinOpExpr> node) { return self().visitExpr(node); }
+  Result visitCallExpr(Ptr<CallExpr> node) { return self().visitExpr(node); }
+  Result visitBlockExpr(Ptr<BlockExpr> node) { return self().visitExpr(node); }
+  Result visitTypeName(Ptr<TypeName> node) { return self().visitType(node); }
+  Result visitUnitType(Ptr<UnitType> node) { return self().visitType(node); }
+  Result visitFuncProto(Ptr<FuncProto> node) { return self().visitNode(node); }
+  Result visitExternFunc(Ptr<ExternFunc> node) {
+    return self().visitFunc(node);
+  }
+  Result visitFuncDef(Ptr<FuncDef> node) { return self().visitFunc(node); }
+  Result visitModule(Ptr<Module> node) { return self().visitNode(node); }
+
+  Result visitExpr(Ptr<Expr> node) { return self().visitNode(node); }
+  Result visitType(Ptr<Type> node) { return self().visitNode(node); }
+  Result visitFunc(Ptr<Func> node) { return self().visitNode(node); }
+  Result visitNode(Ptr<Node>) { return Result(); }
+
+  // Visit the expression and its subexpressions, each before its own
+  // subexpressions, first to last. Around the subexpressions of each
+  // expression, walkPreOrder calls beforeSubexpr(expr, i) before the ith and
+  // afterSubexprs(expr) after the last, which do nothing unless Derived
+  // defines them.
+  void walkPreOrder(Ptr<Expr> root) {
+    assert(walkStack.empty() && "walks don't nest");
+    self().visit(root);
+    walkStack.push_back({root, 0});
+    while (!walkStack.empty()) {
+      WalkFrame& frame = walkStack.back();
+      Ptr<Expr> expr = frame.expr;
+      if (frame.next == numSubexprs(expr)) {
+        walkStack.pop_back();
+        self().afterSubexprs(expr);
+        continue;
+      }
+      usize i = frame.next++;
+      self().beforeSubexpr(expr, i);
+      Ptr<Expr> sub = subexpr(expr, i);
+      self().visit(sub);
+      walkStack.push_back({sub, 0});
+    }
+  }
+
+  void beforeSubexpr(Ptr<Expr>, usize) {}
+  void afterSubexprs(Ptr<Expr>) {}
+
+  // Visit the expression and its subexpressions, each after its own
+  // subexpressions, first to last, and return the root's result. While an
+  // expression is visited, subexprResult(i) is the result of visiting its ith
+  // subexpression.
+  Result walkPostOrder(Ptr<Expr> root) {
+    assert(walkStack.empty() && "walks don't nest");
+    std::vector<Result> results;
+    walkStack.push_back({root, 0});
+    while (true) {
+      WalkFrame& frame = walkStack.back();
+      Ptr<Expr> expr = frame.expr;
+      usize count = numSubexprs(expr);
+      if (frame.next < count) {
+        walkStack.push_back({subexpr(expr, frame.next++), 0});
+        continue;
+      }
+      walkStack.pop_back();
+
+      subexprResults = results.data() + results.size() - count;
+      Result result = self().visit(expr);
+      results.resize(results.size() - count);
+      if (walkStack.empty()) { return result; }
+      results.push_back(result);
+    }
+  }
+
+  Result subexprResult(usize i) const { return subexprResults[i]; }
+
+ private:
+  Derived& self() { return static_cast<Derived&>(*this); }
+
+  // The expressions being walked, innermost last, and how many of the
+  // subexpressions of each have been pushed.
+  struct WalkFrame {
+    Ptr<Expr> expr;
+    usize next;
+  };
+  std::vector<WalkFrame> walkStack;
+
+  const Result* subexprResults = nullptr;
+};
+
+template<typename Derived, typename Result = void>
+using ConstVisitor = Visitor<Derived, Result, true>;
+
 } // namespace ast
 } // namespace fl
 
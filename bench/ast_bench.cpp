@@ -0,0 +1,212 @@
+#include "../parser.h"
+#include "bench.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace fl {
+namespace bench {
+
+namespace {
+
+using namespace ast;
+
+// A copy of the expressions the way the AST was before nodes were tagged
+// with their kind: classes with vtables, told apart with virtual calls or
+// dynamic_cast. They have the same fields as the real nodes, so the walks
+// touch the same amount of memory.
+struct OldExpr {
+  SourceRange location;
+
+  virtual ~OldExpr() {}
+  virtual usize walk() const = 0;
+};
+
+struct OldIntExpr : public OldExpr {
+  i64 val;
+  explicit OldIntExpr(i64 val) : val(val) {}
+  usize walk() const override { return 1; }
+};
+
+struct OldVarExpr : public OldExpr {
+  Symbol name;
+  VarExpr::Binding binding = VarExpr::kUnresolved;
+  u32 index = 0;
+  explicit OldVarExpr(Symbol name) : name(name) {}
+  usize walk() const override { return 1; }
+};
+
+struct OldBinOpExpr : public OldExpr {
+  BinOp op;
+  OldExpr* lhs;
+  OldExpr* rhs;
+  OldBinOpExpr(BinOp op, OldExpr* lhs, OldExpr* rhs)
+      : op(op), lhs(lhs), rhs(rhs) {}
+  usize walk() const override { return 1 + lhs->walk() + rhs->walk(); }
+};
+
+struct OldCallExpr : public OldExpr {
+  OldExpr* functionExpr;
+  Slice<OldExpr*> argumentExprs;
+  OldCallExpr(OldExpr* functionExpr, Slice<OldExpr*> argumentExprs)
+      : functionExpr(functionExpr), argumentExprs(argumentExprs) {}
+  usize walk() const override {
+    usize nodes = 1 + functionExpr->walk();
+    for (const OldExpr* arg : argumentExprs) { nodes += arg->walk(); }
+    return nodes;
+  }
+};
+
+struct OldBlockExpr : public OldExpr {
+  Slice<OldExpr*> exprs;
+  explicit OldBlockExpr(Slice<OldExpr*> exprs) : exprs(exprs) {}
+  usize walk() const override {
+    usize nodes = 1;
+    for (const OldExpr* expr : exprs) { nodes += expr->walk(); }
+    return nodes;
+  }
+};
+
+// Copies expressions into the old representation, in the same arena order
+// the parser allocates them in.
+struct OldExprBuilder : public ConstVisitor<OldExprBuilder, OldExpr*> {
+  Arena* arena;
+
+  explicit OldExprBuilder(Arena* arena) : arena(arena) {}
+
+  Slice<OldExpr*> copyAll(Slice<Expr*> exprs) {
+    std::vector<OldExpr*> copies;
+    for (const Expr* expr : exprs) { copies.push_back(visit(expr)); }
+    return arena->copyArray(copies.data(), copies.size());
+  }
+
+  OldExpr* visitIntExpr(const IntExpr* expr) {
+    return arena->make<OldIntExpr>(expr->val);
+  }
+  OldExpr* visitVarExpr(const VarExpr* expr) {
+    return arena->make<OldVarExpr>(expr->name);
+  }
+  OldExpr* visitBinOpExpr(const BinOpExpr* expr) {
+    OldExpr* lhs = visit(expr->lhs);
+    OldExpr* rhs = visit(expr->rhs);
+    return arena->make<OldBinOpExpr>(expr->op, lhs, rhs);
+  }
+  OldExpr* visitCallExpr(const CallExpr* expr) {
+    OldExpr* functionExpr = visit(expr->functionExpr);
+    return arena->make<OldCallExpr>(functionExpr,
+                                    copyAll(expr->argumentExprs));
+  }
+  OldExpr* visitBlockExpr(const BlockExpr* expr) {
+    return arena->make<OldBlockExpr>(copyAll(expr->exprs));
+  }
+};
+
+// The dynamic_cast chain passes like name resolution used to be written as.
+usize walkDynamicCast(const OldExpr* expr) {
+  if (auto binOp = dynamic_cast<const OldBinOpExpr*>(expr)) {
+    return 1 + walkDynamicCast(binOp->lhs) + walkDynamicCast(binOp->rhs);
+  } else if (auto call = dynamic_cast<const OldCallExpr*>(expr)) {
+    usize nodes = 1 + walkDynamicCast(call->functionExpr);
+    for (const OldExpr* arg : call->argumentExprs) {
+      nodes += walkDynamicCast(arg);
+    }
+    return nodes;
+  } else if (auto block = dynamic_cast<const OldBlockExpr*>(expr)) {
+    usize nodes = 1;
+    for (const OldExpr* subExpr : block->exprs) {
+      nodes += walkDynamicCast(subExpr);
+    }
+    return nodes;
+  } else if (dynamic_cast<const OldVarExpr*>(expr)) {
+    return 1;
+  } else {
+    assert(dynamic_cast<const OldIntExpr*>(expr));
+    return 1;
+  }
+}
+
+struct NodeCounter : public ConstVisitor<NodeCounter, usize> {
+  usize visitIntExpr(const IntExpr*) { return 1; }
+  usize visitVarExpr(const VarExpr*) { return 1; }
+  usize visitBinOpExpr(const BinOpExpr* expr) {
+    return 1 + visit(expr->lhs) + visit(expr->rhs);
+  }
+  usize visitCallExpr(const CallExpr* expr) {
+    usize nodes = 1 + visit(expr->functionExpr);
+    for (const Expr* arg : expr->argumentExprs) { nodes += visit(arg); }
+    return nodes;
+  }
+  usize visitBlockExpr(const BlockExpr* expr) {
+    usize nodes = 1;
+    for (const Expr* subExpr : expr->exprs) { nodes += visit(subExpr); }
+    return nodes;
+  }
+};
+
+// Time `walk` over every body, returning the best time and storing the
+// number of nodes it counted.
+template<typename Body, typename Walk>
+double timeWalk(const std::vector<Body>& bodies, Walk walk,
+                usize iterations, usize* nodes) {
+  double best = 1e300;
+  for (usize i = 0; i < iterations; ++i) {
+    Timer timer;
+    usize count = 0;
+    for (Body body : bodies) { count += walk(body); }
+    best = std::min(best, timer.seconds());
+    *nodes = count;
+  }
+  return best;
+}
+
+} // namespace
+
+void benchASTWalk(const std::string& source, usize iterations) {
+  SourceManager sources;
+  const SourceFile* file = sources.addFile("<bench>", source);
+  Parser parser(file, Parser::kLexUpFront);
+  auto module = parser.parseModule();
+  if (!module) {
+    std::cout << "ast walk: parse failed\n";
+    return;
+  }
+
+  std::vector<const Expr*> bodies;
+  std::vector<const OldExpr*> oldBodies;
+  Arena oldArena;
+  OldExprBuilder builder(&oldArena);
+  for (const Func* fn : module->functions) {
+    if (auto def = dynCast<FuncDef>(fn)) {
+      bodies.push_back(def->body);
+      oldBodies.push_back(builder.visit(def->body));
+    }
+  }
+
+  usize virtualNodes = 0;
+  double virtualTime = timeWalk(
+      oldBodies, [](const OldExpr* body) { return body->walk(); },
+      iterations, &virtualNodes);
+
+  usize dynamicCastNodes = 0;
+  double dynamicCastTime = timeWalk(oldBodies, walkDynamicCast, iterations,
+                                    &dynamicCastNodes);
+
+  usize visitorNodes = 0;
+  double visitorTime = timeWalk(
+      bodies, [](const Expr* body) { return NodeCounter().visit(body); },
+      iterations, &visitorNodes);
+
+  if (virtualNodes != visitorNodes || dynamicCastNodes != visitorNodes) {
+    std::cout << "ast walk: node counts differ\n";
+    return;
+  }
+  report("ast walk (virtual)", virtualTime, source.size(), virtualNodes,
+         "nodes");
+  report("ast walk (dynamic_cast)", dynamicCastTime, source.size(),
+         dynamicCastNodes, "nodes");
+  report("ast walk (visitor)", visitorTime, source.size(), visitorNodes,
+         "nodes");
+}
+
+} // namespace bench
+} // namespace fl
@@ -0,0 +1,85 @@
+#include "bench.h"
+#include <cstdio>
+#include <sstream>
+#include <vector>
+
+namespace fl {
+namespace bench {
+
+void report(StringRef name, double seconds, usize bytes, usize items,
+            StringRef itemName) {
+  std::printf("%-24.*s %10.3f ms %10.1f MB/s %14.0f %.*s/s\n",
+              static_cast<int>(name.length), name.data, seconds * 1e3,
+              bytes / seconds / 1e6, items / seconds,
+              static_cast<int>(itemName.length), itemName.data);
+}
+
+// Pad the name with a run of letters to at least `length` characters.
+std::string padIdentifier(std::string name, usize length) {
+  while (name.size() < length) {
+    name += "abcdefghijklmnopqrstuvwxyz"[name.size() % 26];
+  }
+  return name;
+}
+
+// Write a balanced tree of binary operators `depth` levels deep, with the
+// arguments and small constants at its leaves.
+void writeExpr(std::ostream& o, usize depth, usize* counter,
+               const std::string& lhs, const std::string& rhs) {
+  usize n = (*counter)++;
+  if (depth == 0) {
+    switch (n % 3) {
+      case 0:  o << lhs; break;
+      case 1:  o << rhs; break;
+      default: o << n % 100 + 1;
+    }
+    return;
+  }
+
+  o << '(';
+  writeExpr(o, depth - 1, counter, lhs, rhs);
+  o << ' ' << "+-*/"[n % 4] << ' ';
+  writeExpr(o, depth - 1, counter, lhs, rhs);
+  o << ')';
+}
+
+std::string generateProgram(const ProgramShape& shape) {
+  std::ostringstream o;
+
+  std::vector<std::string> externs;
+  for (usize i = 0; i < shape.externs; ++i) {
+    externs.push_back(padIdentifier("extern_" + std::to_string(i),
+                                    shape.identifierLength));
+    o << "extern fn " << externs.back() << "(c: i32) -> i32\n";
+  }
+  o << '\n';
+
+  auto functionName = [&](usize i) {
+    return padIdentifier("function_" + std::to_string(i),
+                         shape.identifierLength);
+  };
+  std::string lhs = padIdentifier("left_", shape.identifierLength);
+  std::string rhs = padIdentifier("right_", shape.identifierLength);
+
+  usize counter = 0;
+  for (usize i = 0; i < shape.functions; ++i) {
+    o << "fn " << functionName(i) << '(' << lhs << ": i32, " << rhs
+        << ": i32) -> i32 {\n";
+    if (!externs.empty()) {
+      o << "  " << externs[i % externs.size()] << '(' << lhs << " + "
+          << i % 97 << ");\n";
+    }
+    if (i > 0) {
+      o << "  " << functionName(i / 2) << '(' << lhs << " * " << rhs << ", "
+          << i << ");\n";
+    }
+    o << "  ";
+    writeExpr(o, shape.exprDepth, &counter, lhs, rhs);
+    o << "\n}\n\n";
+  }
+
+  return o.str();
+}
+
+} // namespace bench
+} // namespace fl
@@ -0,0 +1,71 @@
+#ifndef BENCH_BENCH_H_
+#define BENCH_BENCH_H_
+
+#include "../util.h"
+#include <chrono>
+#include <string>
+
+namespace fl {
+namespace bench {
+
+// Measures wall time since construction.
+struct Timer {
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+  double seconds() const {
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+  }
+};
+
+// Print one result line with the throughput of the fastest run, in MB/s of
+// source and in `items` (tokens, functions, ...) per second.
+void report(StringRef name, double seconds, usize bytes, usize items,
+            StringRef itemName);
+
+// The shape of a generated program.
+struct ProgramShape {
+  usize functions = 100000;
+
+  // Each function body ends in a balanced tree of binary operators this many
+  // levels deep, so it has 2^depth leaves.
+  usize exprDepth = 3;
+
+  // The minimum length of function and argument names.
+  usize identifierLength = 12;
+
+  // External functions declared, and called from every function (if any).
+  usize externs = 1;
+};
+
+// Generate a synthetic, valid Fiddle program, each function calling an
+// extern and one of the functions before it.
+std::string generateProgram(const ProgramShape& shape);
+
+// Each stage reports its throughput in MB/s of source and in functions of the
+// generated program per second.
+void benchLexer(const std::string& source, usize numFunctions,
+                usize iterations);
+void benchScanKernels(usize iterations);
+
+// Parse with the lexer inline (on demand and up front), pipelined on its own
+// thread, and with the file split across threads.
+void benchParserModes(const std::string& source, usize iterations);
+
+// Walk every expression of an already parsed module with a Visitor, and a
+// copy of it with virtual calls and with dynamic_cast, as the AST used to be.
+void benchASTWalk(const std::string& source, usize iterations);
+
+// Generate IR for an already parsed module.
+void benchCodegen(const std::string& source, usize iterations);
+
+// Parse single expressions with `depth` chained operators and `depth` nested
+// parentheses, far beyond what a recursive parser's stack could handle.
+void benchDeepExpressions(usize depth, usize iterations);
+
+} // namespace bench
+} // namespace fl
+
+#endif /* BENCH_BENCH_H_ */
@@ -0,0 +1,40 @@
+#include "../fold.h"
+#include "../parser.h"
+#include "../resolve.h"
+#include "bench.h"
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <algorithm>
+#include <vector>
+
+namespace fl {
+namespace bench {
+
+void benchCodegen(const std::string& source, usize iterations) {
+  SourceManager sources;
+  const SourceFile* file = sources.addFile("<bench>", source);
+  Parser parser(file, Parser::kLexUpFront);
+  auto module = parser.parseModule();
+  std::vector<Diagnostic> diagnostics;
+  if (!module || !resolveNames(module.get(), &diagnostics)) {
+    std::cout << "codegen: parse failed\n";
+    return;
+  }
+  foldConstants(module.get());
+
+  double best = 1e300;
+  for (usize i = 0; i < iterations; ++i) {
+    // A fresh context each time, so types and constants interned by earlier
+    // runs don't make later ones cheaper.
+    llvm::LLVMContext context;
+    Timer timer;
+    auto llmodule = module->codegen(context, 0, module->functions.size());
+    best = std::min(best, timer.seconds());
+  }
+
+  report("codegen", best, source.size(), module->functions.size(),
+         "functions");
+}
+
+} // namespace bench
+} // namespace fl
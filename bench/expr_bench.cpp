@@ -0,0 +1,58 @@
+#include "../parser.h"
+#include "bench.h"
+#include <algorithm>
+#include <string>
+
+namespace fl {
+namespace bench {
+
+// Wrap an expression in a function so it parses as a module.
+std::string wrapInFunction(const std::string& expr) {
+  return "fn main() -> i32 {\n  " + expr + "\n}\n";
+}
+
+void benchExprSource(const char* name, const std::string& source,
+                     usize numOperators, usize iterations) {
+  SourceManager sources;
+  const SourceFile* file = sources.addFile("<bench>", source);
+
+  double best = 1e300;
+  for (usize i = 0; i < iterations; ++i) {
+    Timer timer;
+    Parser parser(file, Parser::kLexUpFront);
+    auto module = parser.parseModule();
+    best = std::min(best, timer.seconds());
+    if (!module) {
+      std::cout << name << ": parse failed\n";
+      return;
+    }
+  }
+
+  report(name, best, source.size(), numOperators, "operators");
+}
+
+void benchDeepExpressions(usize depth, usize iterations) {
+  // 1 + 2 * 3 - 4 / 5 + ...
+  std::string chain = "1";
+  const char* ops[] = {" + ", " * ", " - ", " / "};
+  for (usize i = 0; i < depth; ++i) {
+    chain += ops[i % 4];
+    chain += std::to_string(i % 10);
+  }
+  benchExprSource("expr (operator chain)", wrapInFunction(chain), depth,
+                  iterations);
+
+  // (((1 + 1) * 2) - 3) ..., nested `depth` parentheses deep.
+  std::string nested(depth, '(');
+  nested += "1";
+  for (usize i = 0; i < depth; ++i) {
+    nested += ops[i % 4];
+    nested += std::to_string(i % 10);
+    nested += ')';
+  }
+  benchExprSource("expr (nested parens)", wrapInFunction(nested), depth,
+                  iterations);
+}
+
+} // namespace bench
+} // namespace fl
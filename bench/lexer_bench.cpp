@@ -0,0 +1,29 @@
+#include "../lexer.h"
+#include "bench.h"
+#include <algorithm>
+#include <vector>
+
+namespace fl {
+namespace bench {
+
+void benchLexer(const std::string& source, usize numFunctions,
+                usize iterations) {
+  double best = 1e300;
+
+  SourceManager sources;
+  const SourceFile* file = sources.addFile("<bench>", source);
+
+  for (usize i = 0; i < iterations; ++i) {
+    std::vector<Diagnostic> diagnostics;
+    Lexer lexer(file, diagnostics);
+
+    Timer timer;
+    while (lexer.nextToken().kind != Token::kEOF) {}
+    best = std::min(best, timer.seconds());
+  }
+
+  report("lexer", best, source.size(), numFunctions, "functions");
+}
+
+} // namespace bench
+} // namespace fl
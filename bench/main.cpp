@@ -0,0 +1,69 @@
+#include "bench.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace fl;
+
+void usage(const char* programName) {
+  std::cout << "usage: " << programName
+      << " [--functions N] [--depth N] [--identifier-length N] [--externs N]\n"
+         "    [--iterations N] [lexer|scan|parser|expr|ast|codegen]\n"
+         "\n"
+         "Each generated function ends in a tree of 2^depth operands.\n";
+}
+
+int main(int argc, char** argv) {
+  bench::ProgramShape shape;
+  usize iterations = 5;
+  const char* only = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    bool hasValue = i + 1 < argc;
+    if (std::strcmp(argv[i], "--functions") == 0 && hasValue) {
+      shape.functions = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--depth") == 0 && hasValue) {
+      shape.exprDepth = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--identifier-length") == 0 && hasValue) {
+      shape.identifierLength = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--externs") == 0 && hasValue) {
+      shape.externs = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--iterations") == 0 && hasValue) {
+      iterations = std::strtoul(argv[++i], nullptr, 10);
+    } else if (argv[i][0] != '-' && !only) {
+      only = argv[i];
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  std::string source = bench::generateProgram(shape);
+  std::cout << "input: " << shape.functions << " functions (depth "
+      << shape.exprDepth << ", identifiers >= " << shape.identifierLength
+      << " chars, " << shape.externs << " externs), " << source.size()
+      << " bytes, best of " << iterations << " runs\n";
+
+  if (!only || std::strcmp(only, "lexer") == 0) {
+    bench::benchLexer(source, shape.functions, iterations);
+  }
+  if (!only || std::strcmp(only, "scan") == 0) {
+    bench::benchScanKernels(iterations);
+  }
+
+  if (!only || std::strcmp(only, "parser") == 0) {
+    bench::benchParserModes(source, iterations);
+  }
+  if (!only || std::strcmp(only, "expr") == 0) {
+    bench::benchDeepExpressions(shape.functions * 10, iterations);
+  }
+
+  if (!only || std::strcmp(only, "ast") == 0) {
+    bench::benchASTWalk(source, iterations);
+  }
+  if (!only || std::strcmp(only, "codegen") == 0) {
+    bench::benchCodegen(source, iterations);
+  }
+
+  return 0;
+}
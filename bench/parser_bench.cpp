@@ -0,0 +1,62 @@
+#include "../parallel.h"
+#include "../parser.h"
+#include "bench.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace fl {
+namespace bench {
+
+// Parse the whole source with the lexer run in the given mode. Returns the
+// number of functions parsed.
+usize parseWithMode(const SourceFile* file, Parser::LexMode mode) {
+  Parser parser(file, mode);
+  auto module = parser.parseModule();
+  parser.scanToEnd();
+  return module ? module->functions.size() : 0;
+}
+
+void benchParserModes(const std::string& source, usize iterations) {
+  SourceManager sources;
+  const SourceFile* file = sources.addFile("<bench>", source);
+
+  struct Mode {
+    Parser::LexMode mode;
+    const char* name;
+  };
+  const Mode modes[] = {
+    {Parser::kLexOnDemand, "parse (lex on demand)"},
+    {Parser::kLexUpFront, "parse (lex up front)"},
+    {Parser::kLexPipelined, "parse (lex pipelined)"},
+  };
+
+  for (const Mode& mode : modes) {
+    double best = 1e300;
+    usize numFunctions = 0;
+
+    for (usize i = 0; i < iterations; ++i) {
+      Timer timer;
+      numFunctions = parseWithMode(file, mode.mode);
+      best = std::min(best, timer.seconds());
+    }
+
+    report(mode.name, best, source.size(), numFunctions, "functions");
+  }
+
+  unsigned jobs = defaultJobs();
+  double best = 1e300;
+  usize numFunctions = 0;
+  for (usize i = 0; i < iterations; ++i) {
+    std::vector<Diagnostic> diagnostics;
+    Timer timer;
+    auto module = parseModuleParallel(file, jobs, &diagnostics);
+    best = std::min(best, timer.seconds());
+    numFunctions = module ? module->functions.size() : 0;
+  }
+  std::string name = "parse (" + std::to_string(jobs) + " threads)";
+  report(name, best, source.size(), numFunctions, "functions");
+}
+
+} // namespace bench
+} // namespace fl
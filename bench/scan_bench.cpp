@@ -0,0 +1,54 @@
+#include "../scan.h"
+#include "bench.h"
+#include <algorithm>
+#include <vector>
+
+namespace fl {
+namespace bench {
+
+// Skip through alternating runs of whitespace and identifier characters and
+// index the newlines, like the lexer does on machine-generated sources.
+usize scanRuns(const ScanKernels& kernels, const std::string& source) {
+  const char* begin = source.data();
+  const char* end = begin + source.size();
+  std::vector<usize> newlines;
+  usize runs = 0;
+
+  for (const char* p = begin; p != end; ++runs) {
+    const char* start = p;
+    p = kernels.skipWhitespace(p, end);
+    kernels.findNewlines(begin, start, p, &newlines);
+    p = kernels.skipIdentifierChars(p, end);
+    if (p != end && !hasClass(*p, kWhitespaceChar | kIdentifierChar)) { ++p; }
+  }
+
+  return runs;
+}
+
+void benchScanKernels(usize iterations) {
+  // Long indentation and long identifiers.
+  std::string source;
+  for (usize i = 0; i < 100000; ++i) {
+    source.append("\n");
+    source.append(4 + i % 60, ' ');
+    source.append("generated_identifier_with_a_long_name_");
+    source.append(std::to_string(i));
+    source.append(";");
+  }
+
+  const ScanKernels* kernelSets[] = {&kScalarScanKernels, &kScanKernels};
+  for (const ScanKernels* kernels : kernelSets) {
+    double best = 1e300;
+    usize runs = 0;
+    for (usize i = 0; i < iterations; ++i) {
+      Timer timer;
+      runs = scanRuns(*kernels, source);
+      best = std::min(best, timer.seconds());
+    }
+    std::string name = std::string("scan/") + kernels->name;
+    report(name, best, source.size(), runs, "runs");
+  }
+}
+
+} // namespace bench
+} // namespace fl
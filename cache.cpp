@@ -0,0 +1,284 @@
+#include "cache.h"
+#include "optimize.h"
+#include "parallel.h"
+#include "stats.h"
+#include <llvm/ADT/OwningPtr.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Linker.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/system_error.h>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+namespace fl {
+
+using namespace ast;
+
+namespace {
+
+// Bump this whenever codegen changes what it generates for the same AST, so
+// older cache entries stop matching.
+const u64 kCacheVersion = 1;
+
+// Feeds a function into an MD5 hash, in a form from which the function could
+// be reconstructed, so that different functions hash differently.
+struct FunctionHasher : public ConstVisitor<FunctionHasher> {
+  llvm::MD5 md5;
+  const Module* module;
+
+  explicit FunctionHasher(const Module* module) : module(module) {}
+
+  void add(u64 value) {
+    u8 bytes[8];
+    for (usize i = 0; i < 8; ++i) { bytes[i] = value >> (i * 8); }
+    md5.update(llvm::ArrayRef<u8>(bytes));
+  }
+
+  // Strings are prefixed with their length, so their ends are unambiguous.
+  void addString(StringRef str) {
+    add(str.length);
+    md5.update(llvm::StringRef(str.data, str.length));
+  }
+
+  void addType(const type::Type* type) {
+    std::ostringstream name;
+    name << *type;
+    addString(name.str());
+  }
+
+  // What codegen declares a function from. Argument names are only given to
+  // definitions, in addDefinition.
+  void addSignature(const FuncProto& proto) {
+    addString(proto.name.str());
+    add(proto.argTypes.size());
+    for (const Type* argType : proto.argTypes) {
+      addType(argType->resolvedType);
+    }
+    addType(proto.returnType->resolvedType);
+  }
+
+  void addDefinition(const FuncDef& def) {
+    addSignature(def.proto);
+    for (Symbol argName : def.proto.argNames) { addString(argName.str()); }
+
+    walkPreOrder(def.body);
+  }
+
+  // Every expression adds its kind and, if it can vary, the number of its
+  // subexpressions, which makes the pre-order unambiguous.
+  void visitIntExpr(const IntExpr* expr) {
+    add(expr->kind);
+    add(expr->val);
+  }
+
+  void visitVarExpr(const VarExpr* expr) {
+    add(expr->kind);
+    add(expr->binding);
+    if (expr->binding == VarExpr::kArgument) {
+      add(expr->index);
+    } else {
+      addSignature(module->functions[expr->index]->proto);
+    }
+  }
+
+  void visitBinOpExpr(const BinOpExpr* expr) {
+    add(expr->kind);
+    add(expr->op);
+  }
+
+  void visitCallExpr(const CallExpr* expr) {
+    add(expr->kind);
+    add(expr->argumentExprs.size());
+  }
+
+  void visitBlockExpr(const BlockExpr* expr) {
+    add(expr->kind);
+    add(expr->exprs.size());
+  }
+};
+
+// The name of the cache file of a definition, as 32 hex digits.
+std::string hashFunction(const Module& module, const FuncDef& def,
+                         unsigned optLevel, StringRef triple) {
+  FunctionHasher hasher(&module);
+  hasher.add(kCacheVersion);
+  hasher.add(static_cast<u64>(LLVM_VERSION_MAJOR));
+  hasher.add(static_cast<u64>(LLVM_VERSION_MINOR));
+  hasher.addString(triple);
+  hasher.add(optLevel);
+  hasher.addDefinition(def);
+
+  llvm::MD5::MD5Result result;
+  hasher.md5.final(result);
+  llvm::SmallString<32> hex;
+  llvm::MD5::stringifyResult(result, hex);
+  return hex.str().str();
+}
+
+// Read a cache entry into *bitcode. Returns false if there's no entry (or
+// it isn't bitcode, which can only happen if something else wrote it).
+bool readCacheFile(const std::string& path, std::string* bitcode) {
+  llvm::OwningPtr<llvm::MemoryBuffer> buffer;
+  if (llvm::MemoryBuffer::getFile(path, buffer)) { return false; }
+  auto start = reinterpret_cast<const unsigned char*>(
+      buffer->getBufferStart());
+  auto end = reinterpret_cast<const unsigned char*>(buffer->getBufferEnd());
+  if (!llvm::isBitcode(start, end)) { return false; }
+  *bitcode = buffer->getBuffer().str();
+  return true;
+}
+
+// Write a cache entry. It's written to a temporary file which is then renamed
+// into place, so other compiles sharing the cache never see half of it.
+bool writeCacheFile(const std::string& path, const std::string& bitcode,
+                    std::string* error) {
+  int fd;
+  llvm::SmallString<128> tempPath;
+  if (llvm::error_code ec = llvm::sys::fs::createUniqueFile(
+          path + ".tmp%%%%%%", fd, tempPath)) {
+    *error = "couldn't create a file next to '" + path + "': " + ec.message();
+    return false;
+  }
+
+  {
+    llvm::raw_fd_ostream out(fd, /* shouldClose = */ true);
+    out << bitcode;
+    out.close();
+    if (out.has_error()) {
+      out.clear_error();
+      *error = "couldn't write '" + tempPath.str().str() + "'";
+      llvm::sys::fs::remove(tempPath.str());
+      return false;
+    }
+  }
+
+  if (llvm::error_code ec = llvm::sys::fs::rename(tempPath.str(), path)) {
+    *error = "couldn't write '" + path + "': " + ec.message();
+    llvm::sys::fs::remove(tempPath.str());
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+std::unique_ptr<llvm::Module> codegenCached(const Module& module,
+                                            const std::string& cacheDir,
+                                            unsigned optLevel,
+                                            unsigned jobs,
+                                            llvm::LLVMContext& context,
+                                            std::string* error) {
+  // The cache can only make a compile faster, never fail it: if entries
+  // can't be written, the functions are still compiled, with a warning.
+  bool writable = true;
+  if (llvm::error_code ec = llvm::sys::fs::create_directories(cacheDir)) {
+    std::cerr << "warning: couldn't create cache directory '" << cacheDir
+        << "': " << ec.message() << '\n';
+    writable = false;
+  }
+
+  // The indices of the definitions in module.functions, and for each its
+  // cache file and bitcode, read from the cache or generated below.
+  std::vector<usize> definitions;
+  std::vector<std::string> paths;
+  std::vector<std::string> bitcode;
+  std::vector<usize> misses;
+  {
+    PhaseTimer timer(kPhaseCache);
+    std::string triple = llvm::sys::getDefaultTargetTriple();
+    for (usize i = 0; i < module.functions.size(); ++i) {
+      auto def = dynCast<FuncDef>(module.functions[i]);
+      if (!def) { continue; }
+      definitions.push_back(i);
+      paths.push_back(cacheDir + "/" +
+                      hashFunction(module, *def, optLevel, triple) + ".bc");
+      bitcode.emplace_back();
+      if (!readCacheFile(paths.back(), &bitcode.back())) {
+        misses.push_back(definitions.size() - 1);
+      }
+    }
+  }
+  if (compileStats.enabled) {
+    compileStats.cacheHits += definitions.size() - misses.size();
+    compileStats.cacheMisses += misses.size();
+  }
+
+  // Split the misses into contiguous partitions with a context each, like
+  // codegenPartitions, but give every function a module of its own. Each
+  // partition counts the entries it couldn't write and keeps the first error.
+  usize numPartitions = std::min<usize>(std::max(jobs, 1u), misses.size());
+  std::vector<usize> writeFailures(numPartitions);
+  std::vector<std::string> writeErrors(numPartitions);
+  if (numPartitions > 1) { llvm::llvm_start_multithreaded(); }
+
+  parallelFor(numPartitions, jobs, [&](usize partition) {
+    usize begin = misses.size() * partition / numPartitions;
+    usize end = misses.size() * (partition + 1) / numPartitions;
+    llvm::LLVMContext partitionContext;
+    for (usize i = begin; i < end; ++i) {
+      usize miss = misses[i];
+      usize index = definitions[miss];
+      auto fnModule = module.codegen(partitionContext, index, index + 1);
+      if (kVerifyIR) { verifyIR(fnModule.get()); }
+      optimizeModule(fnModule.get(), optLevel, /* inlining = */ false);
+
+      llvm::raw_string_ostream out(bitcode[miss]);
+      llvm::WriteBitcodeToFile(fnModule.get(), out);
+      out.flush();
+      std::string writeError;
+      if (!writable ||
+          !writeCacheFile(paths[miss], bitcode[miss], &writeError)) {
+        if (writeFailures[partition]++ == 0) {
+          writeErrors[partition] = writeError;
+        }
+      }
+    }
+  });
+
+  usize failures = 0;
+  std::string firstError;
+  for (usize partition = 0; partition < numPartitions; ++partition) {
+    if (failures == 0) { firstError = writeErrors[partition]; }
+    failures += writeFailures[partition];
+  }
+  // If the directory couldn't be created, that was warned about above.
+  if (writable && failures > 0) {
+    std::cerr << "warning: " << firstError;
+    if (failures > 1) {
+      std::cerr << " (and " << failures - 1 << " more cache entries)";
+    }
+    std::cerr << '\n';
+  }
+  if (compileStats.enabled) { compileStats.cacheWriteFailures += failures; }
+
+  PhaseTimer timer(kPhaseCache);
+  auto linked = make_unique<llvm::Module>("fiddle", context);
+  llvm::Linker linker(linked.get());
+  for (usize i = 0; i < definitions.size(); ++i) {
+    std::unique_ptr<llvm::MemoryBuffer> buffer(
+        llvm::MemoryBuffer::getMemBuffer(bitcode[i], paths[i], false));
+    std::unique_ptr<llvm::Module> fnModule(
+        llvm::ParseBitcodeFile(buffer.get(), context, error));
+    if (!fnModule) {
+      *error = paths[i] + ": " + *error;
+      return nullptr;
+    }
+    if (linker.linkInModule(fnModule.get(), llvm::Linker::DestroySource,
+                            error)) {
+      return nullptr;
+    }
+  }
+
+  return linked;
+}
+
+} // namespace fl
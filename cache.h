@@ -0,0 +1,42 @@
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include "ast.h"
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <memory>
+#include <string>
+
+namespace fl {
+
+/*
+ * Generate and optimize the module like optimizeModule after Module::codegen,
+ * reusing the optimized bitcode of function definitions compiled before from
+ * the cache in `cacheDir` (created if it doesn't exist).
+ *
+ * Each definition is cached in a file of its own, named for an MD5 hash of
+ * everything its code depends on: its resolved AST and prototype, the
+ * prototypes of the functions it refers to, the optimization level, the
+ * target triple and the LLVM version. Editing one function only invalidates
+ * its own entry (and those of its callers, if its prototype changed).
+ *
+ * To keep each function's code independent of the rest of the program, every
+ * definition is generated into a module of its own and optimized without
+ * inlining, and the modules are linked in `context`. Definitions missing from
+ * the cache are generated on up to `jobs` threads.
+ *
+ * If the cache can't be written, the functions are still compiled and a
+ * warning is printed. The counts of hits, misses and entries that couldn't be
+ * written go to the statistics. Returns null and sets *error if the functions
+ * couldn't be linked.
+ */
+std::unique_ptr<llvm::Module> codegenCached(const ast::Module& module,
+                                            const std::string& cacheDir,
+                                            unsigned optLevel,
+                                            unsigned jobs,
+                                            llvm::LLVMContext& context,
+                                            std::string* error);
+
+} // namespace fl
+
+#endif /* CACHE_H_ */
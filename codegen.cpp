@@ -1,7 +1,9 @@
 #include "ast.h"
 #include "codegen.h"
+#include "log.h"
+#include "stats.h"
+#include "trace.h"
 #include "types.h"
-#include <llvm/Analysis/Verifier.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/IRBuilder.h>
@@ -11,109 +13,104 @@
 namespace fl {
 namespace ast {
 
-llvm::Value* IntExpr::codegen(FuncContext* context) const {
-  return llvm::ConstantInt::get(context->module->getContext(),
-                                llvm::APInt(32, val));
-}
+namespace {
 
-llvm::Value* VarExpr::codegen(FuncContext* context) const {
-  const std::vector<llvm::Value*> v = (*context->identifierMap)[name];
-  if (v.empty()) {
-    // TODO(tsion): Diagnose reference to undefined name.
-    return nullptr;
-  }
-  return v.back();
-}
+// Generates the IR of expressions into the current block of a function, in
+// post-order (see Visitor::walkPostOrder).
+struct ExprCodegen : public ConstVisitor<ExprCodegen, llvm::Value*> {
+  FuncContext* context;
 
-llvm::Value* BinOpExpr::codegen(FuncContext* context) const {
-  llvm::Value* left  = lhs->codegen(context);
-  llvm::Value* right = rhs->codegen(context);
-  if (!left || !right) {
-    return nullptr;
-  }
+  explicit ExprCodegen(FuncContext* context) : context(context) {}
 
-  llvm::IRBuilder<> builder{context->currentBlock};
-  if (name == "+") {
-    return builder.CreateAdd(left, right, "add");
-  } else if (name == "-") {
-    return builder.CreateSub(left, right, "sub");
-  } else if (name == "*") {
-    return builder.CreateMul(left, right, "mul");
-  } else if (name == "/") {
-    return builder.CreateSDiv(left, right, "div");
-  } else {
-    return nullptr;
+  llvm::Value* visitIntExpr(const IntExpr* expr) {
+    return llvm::ConstantInt::get(context->module->getContext(),
+                                  llvm::APInt(32, expr->val));
   }
-}
 
-llvm::Value* CallExpr::codegen(FuncContext* context) const {
-  llvm::Value* func = functionExpr->codegen(context);
-  std::vector<llvm::Value*> args;
-  args.reserve(argumentExprs.size());
-  for (const auto& argExpr : argumentExprs) {
-    args.push_back(argExpr->codegen(context));
+  llvm::Value* visitVarExpr(const VarExpr* expr) {
+    switch (expr->binding) {
+      case VarExpr::kArgument: return (*context->arguments)[expr->index];
+      case VarExpr::kFunction:
+        return context->moduleContext->function(expr->index);
+      default:
+        assert(false && "names must be resolved before codegen");
+        return nullptr;
+    }
   }
-  llvm::IRBuilder<> builder{context->currentBlock};
-  return builder.CreateCall(func, args, "call");
-}
 
-llvm::Value* BlockExpr::codegen(FuncContext* context) const {
-  // TODO(tsion): Stop defaulting to integer 0 for empty blocks once we have
-  // multiple types.
-  llvm::Value* val = llvm::ConstantInt::get(context->module->getContext(),
-                                            llvm::APInt(32, 0));
+  llvm::Value* visitBinOpExpr(const BinOpExpr* expr) {
+    llvm::Value* left  = subexprResult(0);
+    llvm::Value* right = subexprResult(1);
+    if (!left || !right) {
+      return nullptr;
+    }
 
-  for (const auto& expr : exprs) {
-    val = expr->codegen(context);
+    llvm::IRBuilder<> builder{context->currentBlock};
+    switch (expr->op) {
+      case kAdd: return builder.CreateAdd(left, right, "add");
+      case kSub: return builder.CreateSub(left, right, "sub");
+      case kMul: return builder.CreateMul(left, right, "mul");
+      case kDiv: return builder.CreateSDiv(left, right, "div");
+      default:   return nullptr;
+    }
   }
 
-  return val;
-}
+  llvm::Value* visitCallExpr(const CallExpr* expr) {
+    llvm::Value* func = subexprResult(0);
+    std::vector<llvm::Value*> args;
+    args.reserve(expr->argumentExprs.size());
+    for (usize i = 1; i <= expr->argumentExprs.size(); ++i) {
+      args.push_back(subexprResult(i));
+    }
+    llvm::IRBuilder<> builder{context->currentBlock};
+    return builder.CreateCall(func, args, "call");
+  }
 
-std::unique_ptr<type::Type> getType(Type* astType) {
-  std::unique_ptr<type::Type> type;
-  if (auto typeName = dynamic_cast<TypeName*>(astType)) {
-    if (typeName->name == "i8") {
-      type = make_unique<type::Int>(8, true);
-    } else if (typeName->name == "i16") {
-      type = make_unique<type::Int>(16, true);
-    } else if (typeName->name == "i32") {
-      type = make_unique<type::Int>(32, true);
-    } else if (typeName->name == "i64") {
-      type = make_unique<type::Int>(64, true);
-    } else {
-      std::cerr << "unknown type '" << typeName->name << "'\n";
-      std::abort();
+  llvm::Value* visitBlockExpr(const BlockExpr* expr) {
+    // TODO(tsion): Stop defaulting to integer 0 for empty blocks once we have
+    // multiple types.
+    if (expr->exprs.empty()) {
+      return llvm::ConstantInt::get(context->module->getContext(),
+                                    llvm::APInt(32, 0));
     }
-  } else if (dynamic_cast<UnitType*>(astType)) {
-    type = make_unique<type::Unit>();
-  } else {
-    std::cerr << "unknown type '" << *type << "'\n";
-    std::abort();
+    return subexprResult(expr->exprs.size() - 1);
   }
-  return type;
-}
 
-llvm::Function* codegenProto(const FuncProto& proto, llvm::Module* module) {
-  llvm::Type* returnType = getType(proto.returnType.get())->llvmType(module);
+  llvm::Value* visitNode(const Node*) {
+    assert(false && "only expressions generate values");
+    return nullptr;
+  }
+};
+
+llvm::Function* codegenProto(const FuncProto& proto, ModuleContext* context) {
+  llvm::Type* returnType =
+      context->llvmTypes.get(proto.returnType->resolvedType);
 
   std::vector<llvm::Type*> argTypes;
+  argTypes.reserve(proto.argTypes.size());
   for (const auto& argType : proto.argTypes) {
-    argTypes.push_back(getType(argType.get())->llvmType(module));
+    argTypes.push_back(context->llvmTypes.get(argType->resolvedType));
   }
 
   return llvm::Function::Create(
       llvm::FunctionType::get(returnType, argTypes, false),
       llvm::GlobalValue::ExternalLinkage,
-      proto.name,
-      module);
+      proto.name.str().toString(),
+      context->module);
 }
 
-void FuncDef::codegen(ModuleContext* context, llvm::Function* llfunc) const {
+void codegenFuncDef(const FuncDef& def, ModuleContext* context,
+                    llvm::Function* llfunc) {
+  const FuncProto& proto = def.proto;
+  TraceScope trace("CodegenFunction");
+  trace.setDetail(proto.name);
+  FL_LOG(kLogCodegen) << "function " << proto.name;
+
+  context->arguments.clear();
   usize i = 0;
   for (auto it = llfunc->arg_begin(); it != llfunc->arg_end(); ++it, ++i) {
-    it->setName(proto.argNames[i]);
-    context->identifierMap[proto.argNames[i]].push_back(it);
+    it->setName(proto.argNames[i].str().toString());
+    context->arguments.push_back(it);
   }
 
   llvm::BasicBlock* entryBlock = llvm::BasicBlock::Create(
@@ -122,39 +119,53 @@ void FuncDef::codegen(ModuleContext* context, llvm::Function* llfunc) const {
       llfunc,
       nullptr);
 
-  FuncContext funcContext{context->module, entryBlock, &context->identifierMap};
-  llvm::Value* result = body->codegen(&funcContext);
-
-  for (const auto& arg : proto.argNames) {
-    context->identifierMap[arg].pop_back();
-  }
+  FuncContext funcContext{context->module, entryBlock, context,
+                          &context->arguments};
+  llvm::Value* result = ExprCodegen(&funcContext).walkPostOrder(def.body);
 
   llvm::IRBuilder<> builder{entryBlock};
   builder.CreateRet(result);
-
-  assert(!llvm::verifyFunction(*llfunc));
 }
 
-std::unique_ptr<llvm::Module> Module::codegen() const {
-  auto llmodule = make_unique<llvm::Module>("fiddle", llvm::getGlobalContext());
-  ModuleContext context(llmodule.get());
+} // namespace
 
-  std::unordered_map<std::string, llvm::Function*> functionMap;
+std::unique_ptr<llvm::Module> Module::codegen() const {
+  return codegen(llvm::getGlobalContext(), 0, functions.size());
+}
 
-  for (const auto& fn : functions) {
-    llvm::Function* llfunc = codegenProto(fn->proto, llmodule.get());
-    context.identifierMap[fn->proto.name].push_back(llfunc);
-    functionMap[fn->proto.name] = llfunc;
+std::unique_ptr<llvm::Module> Module::codegen(llvm::LLVMContext& llcontext,
+                                              usize begin, usize end) const {
+  assert(begin <= end && end <= functions.size());
+  PhaseTimer timer(kPhaseCodegen);
+  auto llmodule = make_unique<llvm::Module>("fiddle", llcontext);
+  ModuleContext context(llmodule.get(), &functions);
+
+  // Declare the functions being generated up front, in order. The rest are
+  // declared only if they're called, so a module of a few functions of a
+  // large program stays small.
+  for (usize i = begin; i < end; ++i) {
+    context.function(i);
   }
 
-  for (const auto& fn : functions) {
-    fn->codegen(&context, functionMap[fn->proto.name]);
+  // Extern functions only have the declaration made above.
+  for (usize i = begin; i < end; ++i) {
+    if (auto def = dynCast<FuncDef>(functions[i])) {
+      codegenFuncDef(*def, &context, context.functions[i]);
+    }
   }
 
-  assert(!llvm::verifyModule(*llmodule));
-
+  if (compileStats.enabled) { compileStats.countInstructions(*llmodule); }
   return llmodule;
-};
+}
 
 } // namespace ast
+
+llvm::Function* ModuleContext::function(u32 index) {
+  llvm::Function*& declaration = functions[index];
+  if (!declaration) {
+    declaration = ast::codegenProto((*astFunctions)[index]->proto, this);
+  }
+  return declaration;
+}
+
 } // namespace fl
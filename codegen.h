@@ -2,18 +2,41 @@
 #define CODEGEN_H_
 
 #include "ast.h"
+#include "symbol.h"
+#include "types.h"
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Value.h>
-#include <unordered_map>
 #include <vector>
 
 namespace fl {
 
+// Names are resolved to indices before codegen (see resolveNames), so they're
+// looked up in these arrays.
 struct ModuleContext {
   llvm::Module* module;
-  std::unordered_map<std::string, std::vector<llvm::Value*>> identifierMap;
 
-  ModuleContext(llvm::Module* module) : module(module) {}
+  // The functions of the ast::Module being generated.
+  const std::vector<ast::Func*>* astFunctions;
+
+  // The declaration of each function, by index in astFunctions, or null if it
+  // hasn't been needed yet (see function()).
+  std::vector<llvm::Function*> functions;
+
+  // The arguments of the function being generated, reused between functions.
+  std::vector<llvm::Value*> arguments;
+
+  type::LLVMTypeCache llvmTypes;
+
+  ModuleContext(llvm::Module* module,
+                const std::vector<ast::Func*>* astFunctions)
+      : module(module),
+        astFunctions(astFunctions),
+        functions(astFunctions->size(), nullptr),
+        llvmTypes(module->getContext()) {}
+
+  // The declaration of the function with the given index, made from its
+  // prototype the first time it's asked for.
+  llvm::Function* function(u32 index);
 };
 
 /**
@@ -23,7 +46,8 @@ struct ModuleContext {
 struct FuncContext {
   llvm::Module* module;
   llvm::BasicBlock* currentBlock;
-  std::unordered_map<std::string, std::vector<llvm::Value*>>* identifierMap;
+  ModuleContext* moduleContext;
+  const std::vector<llvm::Value*>* arguments;
 };
 
 } // namespace fl
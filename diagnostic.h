@@ -1,7 +1,7 @@
 #ifndef DIAGNOSTIC_H_
 #define DIAGNOSTIC_H_
 
-#include "token.h"
+#include "source.h"
 #include <iomanip>
 #include <iostream>
 #include <string>
@@ -27,18 +27,23 @@ const char* const kDiagnosticLevelNames[Diagnostic::kNumDiagnosticLevels] = {
   "fatal", "error", "warning", "info"
 };
 
-inline std::ostream& operator<<(std::ostream& o, const Diagnostic& diag) {
-  SourceCoordinates coords = diag.location.startCoordinates();
+// Print the diagnostic with the line it points into. The file is only looked up
+// here, since diagnostics just store a location.
+inline void printDiagnostic(std::ostream& o, const SourceManager& sources,
+                            const Diagnostic& diag) {
+  const SourceFile* file = sources.getFile(diag.location.start);
+  SourceCoordinates coords = file->findCoordinates(diag.location.start);
 
-  o << diag.location.file->filename << ':' << coords.line << ':'
+  o << file->filename << ':' << coords.line << ':'
       << coords.column << ": " << kDiagnosticLevelNames[diag.level] << ": "
       << diag.message << '\n';
 
-  o << diag.location.file->getLine(coords.line) << '\n';
+  // Streamed files don't keep their text around to quote.
+  if (!file->hasText()) { return; }
 
-  o << std::setw(coords.column) << '^' << '\n';
+  o << file->getLine(coords.line) << '\n';
 
-  return o;
+  o << std::setw(coords.column) << '^' << '\n';
 }
 
 } // namespace fl
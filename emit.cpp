@@ -0,0 +1,114 @@
+#include "emit.h"
+#include "stats.h"
+#include <llvm/ADT/SmallString.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/PassManager.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/FormattedStream.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetOptions.h>
+
+namespace fl {
+
+bool initializeNativeTarget() {
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+  return true;
+}
+
+std::unique_ptr<llvm::TargetMachine> createHostTargetMachine(
+    unsigned optLevel, std::string* error) {
+  // Partitions may be emitted on several threads at once, so register the
+  // target exactly once (function-local statics are initialized thread-safely).
+  static bool initialized = initializeNativeTarget();
+  (void) initialized;
+
+  std::string triple = llvm::sys::getDefaultTargetTriple();
+  const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple,
+                                                                  *error);
+  if (!target) { return nullptr; }
+
+  llvm::CodeGenOpt::Level codegenLevel;
+  switch (optLevel) {
+    case 0:  codegenLevel = llvm::CodeGenOpt::None;       break;
+    case 1:  codegenLevel = llvm::CodeGenOpt::Less;       break;
+    case 2:  codegenLevel = llvm::CodeGenOpt::Default;    break;
+    default: codegenLevel = llvm::CodeGenOpt::Aggressive; break;
+  }
+
+  // Generate position-independent code so the objects link into the PIE
+  // executables most system compilers produce by default.
+  llvm::TargetOptions targetOptions;
+  return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+      triple, llvm::sys::getHostCPUName(), "", targetOptions,
+      llvm::Reloc::PIC_, llvm::CodeModel::Default, codegenLevel));
+}
+
+bool emitObjectFile(llvm::Module* module,
+                    const std::string& filename,
+                    unsigned optLevel,
+                    std::string* error) {
+  PhaseTimer timer(kPhaseEmit);
+  std::unique_ptr<llvm::TargetMachine> targetMachine =
+      createHostTargetMachine(optLevel, error);
+  if (!targetMachine) { return false; }
+
+  const llvm::DataLayout* dataLayout = targetMachine->getDataLayout();
+  module->setTargetTriple(targetMachine->getTargetTriple());
+  module->setDataLayout(dataLayout->getStringRepresentation());
+
+  std::string fileError;
+  llvm::raw_fd_ostream out(filename.c_str(), fileError,
+                           llvm::sys::fs::F_Binary);
+  if (!fileError.empty()) {
+    *error = fileError;
+    return false;
+  }
+
+  llvm::PassManager passes;
+  passes.add(new llvm::DataLayout(*dataLayout));
+
+  llvm::formatted_raw_ostream formattedOut(out);
+  if (targetMachine->addPassesToEmitFile(
+          passes, formattedOut, llvm::TargetMachine::CGFT_ObjectFile)) {
+    *error = "target can't emit object files";
+    return false;
+  }
+
+  passes.run(*module);
+  return true;
+}
+
+bool linkExecutable(const std::vector<std::string>& objectFiles,
+                    const std::string& outputFile,
+                    std::string* error) {
+  PhaseTimer timer(kPhaseEmit);
+  std::string linker = llvm::sys::FindProgramByName("cc");
+  if (linker.empty()) {
+    *error = "couldn't find the system linker driver 'cc'";
+    return false;
+  }
+
+  std::vector<const char*> args;
+  args.push_back(linker.c_str());
+  args.push_back("-o");
+  args.push_back(outputFile.c_str());
+  for (const auto& objectFile : objectFiles) {
+    args.push_back(objectFile.c_str());
+  }
+  args.push_back(nullptr);
+
+  int status = llvm::sys::ExecuteAndWait(linker, args.data(), nullptr,
+                                         nullptr, 0, 0, error);
+  if (status != 0) {
+    if (error->empty()) { *error = "linker command failed"; }
+    return false;
+  }
+  return true;
+}
+
+} // namespace fl
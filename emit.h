@@ -0,0 +1,32 @@
+#ifndef EMIT_H_
+#define EMIT_H_
+
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fl {
+
+// Create a TargetMachine for the host's triple and CPU with code generation
+// tuned for the given optimization level (0-3). Returns nullptr and sets
+// *error if the host target isn't available.
+std::unique_ptr<llvm::TargetMachine> createHostTargetMachine(
+    unsigned optLevel, std::string* error);
+
+// Compile the module to machine code and write it to a native object file.
+bool emitObjectFile(llvm::Module* module,
+                    const std::string& filename,
+                    unsigned optLevel,
+                    std::string* error);
+
+// Link object files into an executable by invoking the system C compiler
+// driver, which knows where the C runtime and libc live.
+bool linkExecutable(const std::vector<std::string>& objectFiles,
+                    const std::string& outputFile,
+                    std::string* error);
+
+} // namespace fl
+
+#endif /* EMIT_H_ */
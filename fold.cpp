@@ -0,0 +1,158 @@
+#include "fold.h"
+#include "stats.h"
+#include <cstdint>
+
+namespace fl {
+
+using namespace ast;
+
+namespace {
+
+// Integer literals are generated as i32 (see ExprCodegen::visitIntExpr), so
+// that's the value they have.
+i32 toI32(i64 val) {
+  return static_cast<i32>(static_cast<u32>(val));
+}
+
+// Compute `lhs op rhs` the way the generated code would. Returns false if
+// that's undefined.
+bool evaluate(BinOp op, i32 lhs, i32 rhs, i32* result) {
+  u32 left = lhs;
+  u32 right = rhs;
+  switch (op) {
+    case kAdd: *result = static_cast<i32>(left + right); return true;
+    case kSub: *result = static_cast<i32>(left - right); return true;
+    case kMul: *result = static_cast<i32>(left * right); return true;
+    case kDiv:
+      if (rhs == 0 || (lhs == INT32_MIN && rhs == -1)) { return false; }
+      *result = lhs / rhs;
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool isLiteral(const IntExpr* literal, i32 val) {
+  return literal && toI32(literal->val) == val;
+}
+
+// Whether dividing by `divisor` can't trap.
+bool isSafeDivisor(const Expr* divisor) {
+  auto literal = dynCast<IntExpr>(divisor);
+  return literal && toI32(literal->val) != 0 && toI32(literal->val) != -1;
+}
+
+// An expression after folding, and whether it's free of side effects.
+struct Folded {
+  Expr* expr;
+  bool pure;
+};
+
+// Folds expressions in post-order (see Visitor::walkPostOrder), so an
+// expression's subexpressions have been folded by the time it is. Each visit
+// method stores its folded subexpressions back into the expression and
+// returns what replaces it.
+struct Folder : public Visitor<Folder, Folded> {
+  Arena* arena;
+
+  explicit Folder(Arena* arena) : arena(arena) {}
+
+  IntExpr* makeInt(i32 val, SourceRange location) {
+    IntExpr* literal = arena->make<IntExpr>(val);
+    literal->location = location;
+    return literal;
+  }
+
+  Folded visitIntExpr(IntExpr* expr) {
+    return {expr, true};
+  }
+
+  Folded visitVarExpr(VarExpr* expr) {
+    return {expr, true};
+  }
+
+  Folded visitBinOpExpr(BinOpExpr* expr) {
+    Folded left = subexprResult(0);
+    Folded right = subexprResult(1);
+    expr->lhs = left.expr;
+    expr->rhs = right.expr;
+    auto lhs = dynCast<IntExpr>(expr->lhs);
+    auto rhs = dynCast<IntExpr>(expr->rhs);
+
+    i32 result;
+    if (lhs && rhs && evaluate(expr->op, toI32(lhs->val), toI32(rhs->val),
+                               &result)) {
+      return {makeInt(result, expr->location), true};
+    }
+
+    switch (expr->op) {
+      case kAdd:
+        if (isLiteral(rhs, 0)) { return left; }
+        if (isLiteral(lhs, 0)) { return right; }
+        break;
+      case kSub:
+        if (isLiteral(rhs, 0)) { return left; }
+        break;
+      case kMul:
+        if (isLiteral(rhs, 1)) { return left; }
+        if (isLiteral(lhs, 1)) { return right; }
+        if ((isLiteral(rhs, 0) && left.pure) ||
+            (isLiteral(lhs, 0) && right.pure)) {
+          return {makeInt(0, expr->location), true};
+        }
+        break;
+      case kDiv:
+        if (isLiteral(rhs, 1)) { return left; }
+        break;
+      default:
+        break;
+    }
+
+    return {expr, left.pure && right.pure &&
+                  (expr->op != kDiv || isSafeDivisor(expr->rhs))};
+  }
+
+  Folded visitCallExpr(CallExpr* expr) {
+    expr->functionExpr = subexprResult(0).expr;
+    for (usize i = 0; i < expr->argumentExprs.size(); ++i) {
+      expr->argumentExprs[i] = subexprResult(i + 1).expr;
+    }
+    return {expr, false};
+  }
+
+  Folded visitBlockExpr(BlockExpr* expr) {
+    // Only the value of the last expression is used.
+    usize count = expr->exprs.size();
+    usize kept = 0;
+    bool allPure = true;
+    for (usize i = 0; i < count; ++i) {
+      Folded folded = subexprResult(i);
+      if (folded.pure && i + 1 < count) { continue; }
+      allPure = allPure && folded.pure;
+      expr->exprs[kept++] = folded.expr;
+    }
+
+    expr->exprs = Slice<Expr*>(expr->exprs.begin(), kept);
+    if (kept == 1) { return {expr->exprs[0], allPure}; }
+    return {expr, allPure};
+  }
+
+  Folded visitNode(Node*) {
+    assert(false && "only expressions are folded");
+    return {nullptr, false};
+  }
+};
+
+} // namespace
+
+void foldConstants(Module* module) {
+  PhaseTimer timer(kPhaseFold);
+  Folder folder(module->arena.get());
+  for (Func* fn : module->functions) {
+    if (auto def = dynCast<FuncDef>(fn)) {
+      def->body = folder.walkPostOrder(def->body).expr;
+    }
+  }
+}
+
+} // namespace fl
@@ -0,0 +1,26 @@
+#ifndef FOLD_H_
+#define FOLD_H_
+
+#include "ast.h"
+
+namespace fl {
+
+// Simplify the bodies of the module's functions before codegen, so no IR is
+// generated only to be deleted again by the optimizer (or never, at -O0):
+//
+//  - Operators on two integer literals are replaced by their result, computed
+//    with the wrapping 32-bit arithmetic of the generated code. Division by
+//    zero and INT32_MIN / -1 are left alone.
+//  - x + 0, 0 + x, x - 0, x * 1, 1 * x and x / 1 become x, and x * 0 and
+//    0 * x become 0 if x has no side effects.
+//  - Expressions of a block other than the last are dropped if they have no
+//    side effects, and a block left with one expression becomes it.
+//
+// An expression has side effects if it contains a call or a division by
+// anything but a constant other than 0 and -1. The module's names must have
+// been resolved (see resolveNames).
+void foldConstants(ast::Module* module);
+
+} // namespace fl
+
+#endif /* FOLD_H_ */
@@ -0,0 +1,79 @@
+#include "jit.h"
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/TargetSelect.h>
+
+namespace fl {
+
+bool runMain(std::unique_ptr<llvm::Module> module,
+             const std::vector<std::string>& args,
+             int* result,
+             std::string* error) {
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  // Make the symbols of the host process (putchar, puts, etc. from libc)
+  // visible to the JIT's symbol resolution so extern fn declarations link
+  // against them.
+  llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+
+  llvm::Function* mainFunc = module->getFunction("main");
+  if (!mainFunc || mainFunc->isDeclaration()) {
+    *error = "no 'main' function defined";
+    return false;
+  }
+
+  // Fiddle has no pointer types yet, so argv is declared as an i64. Either
+  // fn main() -> i32 or fn main(argc: i32, argv: i64) -> i32 is accepted.
+  llvm::FunctionType* mainType = mainFunc->getFunctionType();
+  bool takesArgs = mainType->getNumParams() == 2 &&
+      mainType->getParamType(0)->isIntegerTy(32) &&
+      mainType->getParamType(1)->isIntegerTy(64);
+  if (!mainType->getReturnType()->isIntegerTy(32) ||
+      (mainType->getNumParams() != 0 && !takesArgs)) {
+    *error = "'main' must have type fn() -> i32 or fn(i32, i64) -> i32";
+    return false;
+  }
+
+  llvm::EngineBuilder builder(module.get());
+  builder.setEngineKind(llvm::EngineKind::JIT)
+      .setUseMCJIT(true)
+      .setMCJITMemoryManager(new llvm::SectionMemoryManager())
+      .setErrorStr(error);
+
+  std::unique_ptr<llvm::ExecutionEngine> engine(builder.create());
+  if (!engine) { return false; }
+
+  // The engine owns the module from here on.
+  module.release();
+  engine->finalizeObject();
+
+  void* mainPtr = engine->getPointerToFunction(mainFunc);
+  if (!mainPtr) {
+    *error = "failed to JIT-compile 'main'";
+    return false;
+  }
+
+  if (takesArgs) {
+    std::vector<char*> argv;
+    argv.reserve(args.size() + 1);
+    for (const auto& arg : args) {
+      argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    auto mainFn = reinterpret_cast<int (*)(int, char**)>(mainPtr);
+    *result = mainFn(static_cast<int>(args.size()), argv.data());
+  } else {
+    auto mainFn = reinterpret_cast<int (*)()>(mainPtr);
+    *result = mainFn();
+  }
+
+  return true;
+}
+
+} // namespace fl
@@ -0,0 +1,22 @@
+#ifndef JIT_H_
+#define JIT_H_
+
+#include <llvm/IR/Module.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fl {
+
+// JIT-compile the module in memory and call its `main` function with the given
+// program arguments (args[0] is conventionally the script name). Extern
+// functions are resolved against the symbols of the host process. Returns
+// false and sets *error if the module can't be run.
+bool runMain(std::unique_ptr<llvm::Module> module,
+             const std::vector<std::string>& args,
+             int* result,
+             std::string* error);
+
+} // namespace fl
+
+#endif /* JIT_H_ */
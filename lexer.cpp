@@ -1,43 +1,62 @@
 #include "lexer.h"
+#include "scan.h"
+#include "stats.h"
 #include <cstring>
-#include <unordered_map>
 
 namespace fl {
 
-bool isAscii(char c) {
-  return !(c & 0x80);
-}
-
 bool isDigit(char c) {
-  return c >= '0' && c <= '9';
+  return hasClass(c, kDigitChar);
 }
 
-bool isOperatorChar(char c) {
-  const char kOperatorChars[] = "~!@#$%^&*-+=|/?<>.";
-  return std::strchr(kOperatorChars, c) != nullptr;
+i64 digitToInt(char c) {
+  assert(isDigit(c));
+  return c - '0';
 }
 
-bool isIdentifierChar(char c) {
-  return (c >= 'a' && c <= 'z')
-      || (c >= 'A' && c <= 'Z')
-      || c == '_'
-      || isDigit(c);
+// FNV-1a, in a recursive form usable in constant expressions so the fixed
+// spellings of tokens can be hashed at compile time.
+constexpr u32 hashSpelling(const char* str, usize length,
+                           u32 hash = 2166136261u) {
+  return length == 0 ? hash
+      : hashSpelling(str + 1, length - 1,
+                     (hash ^ static_cast<u8>(*str)) * 16777619u);
 }
 
-bool isWhitespace(char c) {
-  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+// The same hash as a loop, for arbitrarily long text at runtime.
+inline u32 hashText(StringRef text) {
+  u32 hash = 2166136261u;
+  for (char c : text) {
+    hash = (hash ^ static_cast<u8>(c)) * 16777619u;
+  }
+  return hash;
 }
 
-i64 digitToInt(char c) {
-  assert(isDigit(c));
-  return c - '0';
+// Return the kind of the keyword or special operator spelled `text`, or
+// `otherwise` if it isn't one. The switch over the compile-time hashes of the
+// fixed spellings in DEFINE_TOKEN_KINDS is a perfect hash: if two spellings
+// ever collide, the duplicate case label won't compile.
+Token::TokenKind lookupSpelling(StringRef text, u32 hash,
+                                Token::TokenKind otherwise) {
+  switch (hash) {
+#define X(name, description)
+#define K(name, description, spelling) \
+    case hashSpelling(spelling, sizeof(spelling) - 1): \
+      return text == StringRef(spelling, sizeof(spelling) - 1) \
+          ? Token::name : otherwise;
+    DEFINE_TOKEN_KINDS(X, K)
+#undef K
+#undef X
+    default:
+      return otherwise;
+  }
 }
 
 void Lexer::scanInt(Token* token) {
   token->kind = Token::kInteger;
-  scanChars(isIdentifierChar);
-  token->location.end = byteOffset;
-  StringRef str = token->text();
+  usize start = byteOffset;
+  scanIdentifierChars();
+  StringRef str = textFrom(start);
 
   i64 result = 0;
   i64 base = 1;
@@ -46,7 +65,7 @@ void Lexer::scanInt(Token* token) {
     char c = str[i];
     if (!isDigit(c)) {
       report(Diagnostic::kError, "non-decimal digit in integer literal",
-             token->location.start + i);
+             start + i);
       token->intValue = 0;
       return;
     }
@@ -59,56 +78,49 @@ void Lexer::scanInt(Token* token) {
   token->intValue = result;
 }
 
-const std::unordered_map<std::string, Token::TokenKind> kKeywords{
-  {"enum", Token::kKeywordEnum},
-  {"extern", Token::kKeywordExtern},
-  {"fn", Token::kKeywordFn},
-  {"struct", Token::kKeywordStruct},
-};
+Symbol Lexer::internIdentifier(StringRef text, u32 hash) {
+  SymbolCacheEntry& entry = symbolCache[hash % kSymbolCacheSize];
+  if (entry.length == text.length && entry.data &&
+      std::memcmp(entry.data, text.data, text.length) == 0) {
+    return entry.symbol;
+  }
 
-// Like keywords, but for operator characters.
-const std::unordered_map<std::string, Token::TokenKind> kSpecialOperators{
-  {"->", Token::kArrowRight},
-  {"<-", Token::kArrowLeft},
-};
+  entry.data = text.data;
+  entry.length = text.length;
+  entry.symbol = Symbol::intern(text);
+  return entry.symbol;
+}
 
-Token Lexer::nextToken() {
-  if (!atEnd()) {
-    scanChars(isWhitespace);
-  }
+Token Lexer::lexToken() {
+  skipWhitespace();
+
+  Token token;
+  usize start = byteOffset;
+  token.location.start = locationOf(start);
 
   if (atEnd()) {
-    Token token;
     token.kind = Token::kEOF;
-    token.location = SourceRange{sourceFile, byteOffset, byteOffset};
+    token.location.end = token.location.start;
     return token;
   }
 
-  Token token;
-  token.kind = Token::kInvalid;
-  token.location.file = sourceFile;
-  token.location.start = byteOffset;
-
   char c = currChar();
+  u8 charClass = kCharClasses[static_cast<u8>(c)];
 
-  if (isDigit(c)) {
+  if (charClass & kDigitChar) {
     scanInt(&token);
-  } else if (isIdentifierChar(c)) {
-    scanChars(isIdentifierChar);
-    auto it = kKeywords.find(textFrom(token.location.start).toString());
-    if (it == kKeywords.end()) {
-      token.kind = Token::kIdentifier;
-    } else {
-      token.kind = it->second;
-    }
-  } else if (isOperatorChar(c)) {
-    scanChars(isOperatorChar);
-    auto it = kSpecialOperators.find(textFrom(token.location.start).toString());
-    if (it == kSpecialOperators.end()) {
-      token.kind = Token::kOperator;
-    } else {
-      token.kind = it->second;
+  } else if (charClass & kIdentifierChar) {
+    scanIdentifierChars();
+    StringRef text = textFrom(start);
+    u32 hash = hashText(text);
+    token.kind = lookupSpelling(text, hash, Token::kIdentifier);
+    if (token.kind == Token::kIdentifier) {
+      token.symbol = internIdentifier(text, hash);
     }
+  } else if (charClass & kOperatorChar) {
+    scanChars(kOperatorChar);
+    StringRef text = textFrom(start);
+    token.kind = lookupSpelling(text, hashText(text), Token::kOperator);
   } else {
     switch (c) {
       case '(': token.kind = Token::kParenLeft;    break;
@@ -125,20 +137,98 @@ Token Lexer::nextToken() {
     consumeChar();
   }
 
-  token.location.end = byteOffset;
+  token.location.end = locationOf(byteOffset);
   return token;
 }
 
-void Lexer::scanChars(bool (*pred)(char)) {
-  while (!atEnd()) {
-    char c = currChar();
-    if (!pred(c)) { break; }
-    consumeChar();
+// A token that runs into the end of the buffer (or the whitespace before it,
+// or EOF) may continue in the next chunk of the stream. Then the stream is
+// refilled and the token lexed again from its start, until the token ends
+// inside the buffer or the stream ends.
+Token Lexer::nextStreamedToken() {
+  while (true) {
+    usize start = byteOffset;
+    usize numDiagnostics = diagnostics.size();
+    Token token = lexToken();
+    if (byteOffset < endOffset || stream->finished) { return token; }
+
+    diagnostics.erase(diagnostics.begin() + numDiagnostics,
+                      diagnostics.end());
+    stream->refill(bufferStart + start);
+    buffer = stream->window();
+    bufferStart = stream->windowStart;
+    byteOffset = 0;
+    endOffset = buffer.length;
+
+    // The cached identifiers point into the old buffer.
+    for (SymbolCacheEntry& entry : symbolCache) {
+      entry = SymbolCacheEntry();
+    }
+  }
+}
+
+void Lexer::logToken(const Token& token) {
+  LogLine line(kLogLex);
+  printToken(line.stream(), token, text(token));
+}
+
+void Lexer::lexAll(TokenBuffer* tokens) {
+  PhaseTimer timer(kPhaseLex);
+  // Typical source has a token every four or five bytes, so this avoids most
+  // of the regrowth without overallocating much.
+  tokens->reserve(tokens->size() + (endOffset - byteOffset) / 4 + 1);
+  Token token;
+  do {
+    token = nextToken();
+    tokens->push(token);
+  } while (token.kind != Token::kEOF);
+}
+
+void Lexer::scanChars(u8 charClass) {
+  const char* begin = source().data;
+  const char* p = begin + byteOffset;
+  const char* end = begin + endOffset;
+  while (p != end && hasClass(*p, charClass)) { ++p; }
+  byteOffset = p - begin;
+}
+
+// Most runs of whitespace and identifier characters are short, so the first
+// few bytes are scanned inline and the vector kernels only called for runs
+// longer than this.
+const usize kInlineScanLength = 16;
+
+void Lexer::scanIdentifierChars() {
+  const char* begin = source().data;
+  const char* p = begin + byteOffset;
+  const char* end = begin + endOffset;
+  const char* inlineEnd = static_cast<usize>(end - p) > kInlineScanLength
+      ? p + kInlineScanLength : end;
+
+  while (p != inlineEnd && hasClass(*p, kIdentifierChar)) { ++p; }
+  if (p == inlineEnd && p != end) {
+    p = kScanKernels.skipIdentifierChars(p, end);
   }
+
+  byteOffset = p - begin;
+}
+
+void Lexer::skipWhitespace() {
+  const char* begin = source().data;
+  const char* p = begin + byteOffset;
+  const char* end = begin + endOffset;
+  const char* inlineEnd = static_cast<usize>(end - p) > kInlineScanLength
+      ? p + kInlineScanLength : end;
+
+  while (p != inlineEnd && hasClass(*p, kWhitespaceChar)) { ++p; }
+  if (p == inlineEnd && p != end) {
+    p = kScanKernels.skipWhitespace(p, end);
+  }
+
+  byteOffset = p - begin;
 }
 
 StringRef Lexer::textFrom(usize byteStart) const {
-  return StringRef{source().data() + byteStart, byteOffset - byteStart};
+  return StringRef{source().data + byteStart, byteOffset - byteStart};
 }
 
 char Lexer::currChar() {
@@ -148,22 +238,18 @@ char Lexer::currChar() {
 
 void Lexer::consumeChar() {
   assert(!atEnd());
-  if (currChar() == '\n') {
-    sourceFile->newlineOffsets.push_back(byteOffset);
-  }
   ++byteOffset;
 }
 
 bool Lexer::atEnd() const {
-  return byteOffset == source().size();
+  return byteOffset == endOffset;
 }
 
 void Lexer::report(Diagnostic::DiagnosticLevel level, StringRef message,
                    usize offset) {
+  SourceLoc loc = locationOf(offset);
   diagnostics.emplace_back(
-      Diagnostic{level,
-                 message.toString(),
-                 SourceRange{sourceFile, offset, offset}});
+      Diagnostic{level, message.toString(), SourceRange{loc, loc}});
 }
 
 } // namespace fl
@@ -2,37 +2,109 @@
 #define LEXER_H_
 
 #include "diagnostic.h"
+#include "log.h"
+#include "symbol.h"
 #include "token.h"
 #include "util.h"
 #include <cassert>
 #include <cstring>
 #include <iostream>
-#include <memory>
 #include <string>
 #include <vector>
 
 namespace fl {
 
 struct Lexer {
+  // The position in `buffer`.
   usize byteOffset = 0;
-  std::shared_ptr<SourceFile> sourceFile;
+  const SourceFile* sourceFile;
   std::vector<Diagnostic>& diagnostics;
 
-  explicit Lexer(std::shared_ptr<SourceFile> file,
-                 std::vector<Diagnostic>& diagnostics)
+  // The text being lexed: the whole file, or a window of a streamed file
+  // starting at file offset `bufferStart`.
+  StringRef buffer;
+  usize bufferStart = 0;
+
+  // Where the lexer stops and produces EOF, normally the end of the buffer.
+  usize endOffset;
+
+  // Only set when lexing a streamed file.
+  SourceStream* stream = nullptr;
+
+  // The file must outlive the lexer and any tokens it produces.
+  explicit Lexer(const SourceFile* file, std::vector<Diagnostic>& diagnostics)
       : sourceFile(file),
-        diagnostics(diagnostics) {}
+        diagnostics(diagnostics),
+        buffer(file->source),
+        endOffset(file->source.length) {}
+
+  // Lex only the bytes in [begin, end) of the file.
+  Lexer(const SourceFile* file, std::vector<Diagnostic>& diagnostics,
+        usize begin, usize end)
+      : byteOffset(begin),
+        sourceFile(file),
+        diagnostics(diagnostics),
+        buffer(file->source),
+        endOffset(end) {
+    assert(begin <= end && end <= file->source.length);
+  }
 
-  Token nextToken();
-  const std::string& source() const { return sourceFile->source; }
+  // Lex the file read by the stream, refilling it as needed.
+  Lexer(SourceStream* stream, std::vector<Diagnostic>& diagnostics)
+      : sourceFile(stream->file),
+        diagnostics(diagnostics),
+        buffer(stream->window()),
+        bufferStart(stream->windowStart),
+        endOffset(buffer.length),
+        stream(stream) {}
+
+  Token nextToken() {
+    Token token = stream ? nextStreamedToken() : lexToken();
+    if (logEnabled(kLogLex)) { logToken(token); }
+    return token;
+  }
+
+  // Lex the rest of the file into the buffer, up to and including the EOF
+  // token.
+  void lexAll(TokenBuffer* tokens);
+  StringRef source() const { return buffer; }
+
+  // The text of a token produced by this lexer. For a streamed file, the
+  // text is only available until the next token is lexed.
+  StringRef text(const Token& token) const {
+    usize start = sourceFile->toOffset(token.location.start) - bufferStart;
+    usize end = sourceFile->toOffset(token.location.end) - bufferStart;
+    assert(start <= end && end <= buffer.length);
+    return StringRef{buffer.data + start, end - start};
+  }
 
  private:
+  // A direct-mapped cache from identifier text in this file to its Symbol, so
+  // repeated identifiers skip the global symbol table and its lock.
+  struct SymbolCacheEntry {
+    const char* data = nullptr;
+    usize length = 0;
+    Symbol symbol;
+  };
+  static const usize kSymbolCacheSize = 1024;
+  SymbolCacheEntry symbolCache[kSymbolCacheSize];
+
+  Token lexToken();
+  Token nextStreamedToken();
+  void logToken(const Token& token);
   void scanInt(Token* token);
-  void scanChars(bool (*pred)(char));
+  void scanChars(u8 charClass);
+  void scanIdentifierChars();
+  void skipWhitespace();
+  Symbol internIdentifier(StringRef text, u32 hash);
   char currChar();
   void consumeChar();
   bool atEnd() const;
   StringRef textFrom(usize position) const;
+  SourceLoc locationOf(usize offset) const {
+    return SourceLoc(sourceFile->startLoc.offset +
+                     static_cast<u32>(bufferStart + offset));
+  }
   void report(Diagnostic::DiagnosticLevel level, StringRef message,
               usize location);
 };
@@ -0,0 +1,94 @@
+#include "log.h"
+#include <unistd.h>
+#include <mutex>
+#include <string>
+
+namespace fl {
+
+const char* const kLogCategoryNames[kNumLogCategories] = {
+  "lex", "parse", "codegen"
+};
+
+u32 enabledLogCategories = 0;
+
+namespace {
+
+// The lines waiting to be written, flushed once they exceed kFlushSize and
+// when the buffer is destroyed at exit.
+struct LogBuffer {
+  static const usize kFlushSize = 64 * 1024;
+
+  std::mutex mutex;
+  std::string text;
+
+  ~LogBuffer() { flush(); }
+
+  void append(const std::string& line) {
+    std::lock_guard<std::mutex> lock(mutex);
+    text += line;
+    if (text.size() >= kFlushSize) { writeOut(); }
+  }
+
+  void flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    writeOut();
+  }
+
+ private:
+  void writeOut() {
+    const char* p = text.data();
+    usize remaining = text.size();
+    while (remaining > 0) {
+      isize written = write(STDERR_FILENO, p, remaining);
+      if (written < 0) { break; }
+      p += written;
+      remaining -= written;
+    }
+    text.clear();
+  }
+};
+
+LogBuffer& logBuffer() {
+  static LogBuffer buffer;
+  return buffer;
+}
+
+} // namespace
+
+bool enableLogCategories(StringRef names, std::string* error) {
+  usize start = 0;
+  while (start <= names.length) {
+    usize end = start;
+    while (end < names.length && names[end] != ',') { ++end; }
+    StringRef name{names.data + start, end - start};
+
+    if (name == "all") {
+      enabledLogCategories = (1u << kNumLogCategories) - 1;
+    } else {
+      usize i = 0;
+      while (i < kNumLogCategories && name != kLogCategoryNames[i]) { ++i; }
+      if (i == kNumLogCategories) {
+        *error = "unknown debug category '" + name.toString() + "'";
+        return false;
+      }
+      enabledLogCategories |= 1u << i;
+    }
+    start = end + 1;
+  }
+  return true;
+}
+
+void flushLog() {
+  logBuffer().flush();
+}
+
+LogLine::LogLine(LogCategory category) {
+  line << '[' << kLogCategoryNames[category] << "] ";
+}
+
+LogLine::~LogLine() {
+  line << '\n';
+  logBuffer().append(line.str());
+}
+
+} // namespace fl
@@ -0,0 +1,84 @@
+#ifndef LOG_H_
+#define LOG_H_
+
+#include "util.h"
+#include <sstream>
+
+// Debug logging is compiled in by default only when asserts are, so release
+// builds pay nothing for it. Build with `scons log=1` to keep it in a release
+// build.
+#ifndef FL_LOGGING
+#ifdef NDEBUG
+#define FL_LOGGING 0
+#else
+#define FL_LOGGING 1
+#endif
+#endif
+
+namespace fl {
+
+enum LogCategory {
+  kLogLex,
+  kLogParse,
+  kLogCodegen,
+
+  kNumLogCategories
+};
+
+extern const char* const kLogCategoryNames[kNumLogCategories];
+
+// The categories enabled at runtime (by --debug), one bit per category. Set
+// before any other thread starts.
+extern u32 enabledLogCategories;
+
+inline bool logEnabled(LogCategory category) {
+  return FL_LOGGING && (enabledLogCategories & (1u << category));
+}
+
+// Enable the categories in a comma-separated list of names like "lex,parse",
+// or every category for "all". Returns false and sets *error for an unknown
+// name.
+bool enableLogCategories(StringRef names, std::string* error);
+
+// Write out everything logged so far. Log lines are buffered in memory and
+// only written to stderr in large blocks, and when the process exits.
+void flushLog();
+
+/*
+ * One line of the log, written out when the LogLine is destroyed. The line is
+ * built up privately, so lines logged by different threads at once don't
+ * interleave.
+ */
+struct LogLine {
+  explicit LogLine(LogCategory category);
+  ~LogLine();
+
+  LogLine(const LogLine&) = delete;
+  LogLine& operator=(const LogLine&) = delete;
+
+  std::ostream& stream() { return line; }
+
+ private:
+  std::ostringstream line;
+};
+
+// Turns a log statement into a void expression for FL_LOG. The & binds more
+// loosely than << and more tightly than ?:.
+struct LogVoidify {
+  void operator&(std::ostream&) {}
+};
+
+} // namespace fl
+
+// Log a line in a category if it's enabled, e.g.:
+//
+//   FL_LOG(kLogParse) << "function " << name;
+//
+// When logging is compiled out, or the category isn't enabled, the operands
+// of << aren't evaluated. It's a single expression rather than an if, so an
+// else after it can't bind to a hidden if.
+#define FL_LOG(category) \
+  !::fl::logEnabled(::fl::category) ? (void) 0 \
+      : ::fl::LogVoidify() & ::fl::LogLine(::fl::category).stream()
+
+#endif /* LOG_H_ */
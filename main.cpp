@@ -1,49 +1,475 @@
+#include "cache.h"
 #include "editline.h"
+#include "emit.h"
+#include "fold.h"
+#include "jit.h"
 #include "lexer.h"
+#include "log.h"
+#include "optimize.h"
+#include "parallel.h"
 #include "parser.h"
+#include "resolve.h"
+#include "stats.h"
+#include "trace.h"
 #include "util.h"
+#include <llvm/ADT/SmallString.h>
 #include <llvm/IR/Module.h>
-#include <fstream>
+#include <llvm/Support/FileSystem.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <sstream>
 #include <string>
 #include <vector>
 
 using namespace fl;
 using namespace llvm;
 
-void runFnTest(std::string filename, std::string source) {
-  Parser parser{SourceFile{filename, source}};
+struct Options {
+  // JIT-compile the module and call its main function instead of dumping it.
+  bool run = false;
+
+  // Optimization level from -O0 to -O3.
+  unsigned optLevel = 0;
+
+  // Dump the IR before and after optimization to stderr.
+  bool printIR = false;
+
+  // Emit an object file instead of linking an executable (-c).
+  bool compileOnly = false;
+
+  // Output object file or executable (-o).
+  const char* outputFile = nullptr;
+
+  // Number of threads for code generation and optimization (-j). With more
+  // than one, functions are split into partitions compiled in parallel.
+  unsigned jobs = 1;
+
+  // Print phase times and counters to stderr after compiling a file (--stats,
+  // or -ftime-report like clang's), or as JSON with --stats=json.
+  enum StatsFormat { kNoStats, kStatsTable, kStatsJSON };
+  StatsFormat stats = kNoStats;
+
+  // Write a Chrome trace of the compile to this file (--time-trace=file),
+  // leaving out events shorter than the granularity in microseconds
+  // (--time-trace-granularity=n).
+  const char* timeTraceFile = nullptr;
+  unsigned timeTraceGranularity = 500;
+
+  // Reuse the code of functions compiled before from this directory, and
+  // add that of the rest (--cache-dir=dir). See codegenCached.
+  const char* cacheDir = nullptr;
+
+  // Debug log categories to enable (--debug=lex,parse). Only debug builds
+  // (or builds with log=1) have logging compiled in.
+  const char* debugCategories = nullptr;
+
+  // The input file, or "-" for standard input.
+  const char* filename = nullptr;
+
+  // Arguments following the filename, passed to main in --run mode.
+  std::vector<std::string> programArgs;
+};
+
+void usage(const char* programName) {
+  std::cerr << "usage: " << programName
+      << " [--run] [-c] [-o output] [-O0|-O1|-O2|-O3] [-j jobs] "
+         "[--print-ir] [--stats[=json]]\n"
+         "    [--time-trace=out.json [--time-trace-granularity=us]] "
+         "[--debug=lex,parse,codegen]\n"
+         "    [--cache-dir=dir] [file.fl|- [args...]]\n";
+}
+
+bool parseArgs(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    if (options->filename && options->run) {
+      options->programArgs.push_back(arg);
+    } else if (std::strcmp(arg, "--run") == 0) {
+      options->run = true;
+    } else if (std::strcmp(arg, "--print-ir") == 0) {
+      options->printIR = true;
+    } else if (std::strcmp(arg, "--stats") == 0 ||
+               std::strcmp(arg, "-ftime-report") == 0) {
+      options->stats = Options::kStatsTable;
+    } else if (std::strcmp(arg, "--stats=json") == 0) {
+      options->stats = Options::kStatsJSON;
+    } else if (std::strncmp(arg, "--time-trace=", 13) == 0) {
+      options->timeTraceFile = arg + 13;
+    } else if (std::strncmp(arg, "--time-trace-granularity=", 25) == 0) {
+      char* end;
+      options->timeTraceGranularity = std::strtoul(arg + 25, &end, 10);
+      if (*end != '\0' || end == arg + 25) {
+        std::cerr << "invalid granularity '" << arg + 25 << "'\n";
+        return false;
+      }
+    } else if (std::strncmp(arg, "--cache-dir=", 12) == 0) {
+      options->cacheDir = arg + 12;
+    } else if (std::strncmp(arg, "--debug=", 8) == 0) {
+      options->debugCategories = arg + 8;
+    } else if (std::strcmp(arg, "-c") == 0) {
+      options->compileOnly = true;
+    } else if (std::strcmp(arg, "-o") == 0) {
+      if (++i == argc) {
+        std::cerr << "missing filename after '-o'\n";
+        return false;
+      }
+      options->outputFile = argv[i];
+    } else if (std::strncmp(arg, "-j", 2) == 0) {
+      const char* jobs = arg + 2;
+      if (*jobs == '\0') {
+        if (++i == argc) {
+          std::cerr << "missing job count after '-j'\n";
+          return false;
+        }
+        jobs = argv[i];
+      }
+      char* end;
+      options->jobs = std::strtoul(jobs, &end, 10);
+      if (*end != '\0') {
+        std::cerr << "invalid job count '" << jobs << "'\n";
+        return false;
+      }
+      if (options->jobs == 0) { options->jobs = defaultJobs(); }
+    } else if (arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' &&
+               arg[2] <= '3' && arg[3] == '\0') {
+      options->optLevel = arg[2] - '0';
+    } else if (arg[0] == '-' && arg[1] != '\0') {
+      std::cerr << "unknown option '" << arg << "'\n";
+      return false;
+    } else if (options->filename) {
+      std::cerr << "unexpected argument '" << arg << "'\n";
+      return false;
+    } else {
+      options->filename = arg;
+      options->programArgs.push_back(arg);
+    }
+  }
+  return true;
+}
+
+std::unique_ptr<llvm::Module> codegenModule(const ast::Module& module,
+                                           const Options& options) {
+  if (options.cacheDir) {
+    std::string error;
+    auto llmodule = codegenCached(module, options.cacheDir, options.optLevel,
+                                  options.jobs, getGlobalContext(), &error);
+    if (!llmodule) {
+      std::cerr << "error: " << error << '\n';
+      return nullptr;
+    }
+    if (options.printIR) {
+      std::cerr << "; IR after optimization (-O" << options.optLevel
+          << ", cached)\n";
+      llmodule->dump();
+    }
+    return llmodule;
+  }
+
+  if (options.jobs > 1) {
+    std::string error;
+    auto llmodule = linkPartitions(
+        codegenPartitions(module, options.jobs, options.optLevel),
+        getGlobalContext(), &error);
+    if (!llmodule) {
+      std::cerr << "error: failed to link partitions: " << error << '\n';
+      return nullptr;
+    }
+    if (options.printIR) {
+      std::cerr << "; IR after optimization (-O" << options.optLevel
+          << ", " << options.jobs << " partitions)\n";
+      llmodule->dump();
+    }
+    return llmodule;
+  }
+
+  auto llmodule = module.codegen();
+  if (kVerifyIR) { verifyIR(llmodule.get()); }
+
+  if (options.printIR) {
+    std::cerr << "; IR before optimization\n";
+    llmodule->dump();
+  }
+
+  optimizeModule(llmodule.get(), options.optLevel);
+
+  if (options.printIR) {
+    std::cerr << "; IR after optimization (-O" << options.optLevel << ")\n";
+    llmodule->dump();
+  }
+
+  return llmodule;
+}
+
+// Count a parsed file and its module (null if parsing failed) in the
+// statistics, if they're enabled.
+void countParsed(const SourceFile* file, const ast::Module* module) {
+  if (!compileStats.enabled) { return; }
+  compileStats.sourceBytes += file->size();
+  if (module) { compileStats.countModule(*module); }
+}
+
+// Resolve the names in a parsed module, printing any errors, and fold its
+// constants. Returns false if the module can't be compiled.
+bool resolveModule(ast::Module* module, const SourceManager& sources,
+                   std::ostream& o) {
+  std::vector<Diagnostic> diagnostics;
+  bool ok = resolveNames(module, &diagnostics);
+  for (const auto& diag : diagnostics) {
+    printDiagnostic(o, sources, diag);
+  }
+  if (ok) { foldConstants(module); }
+  return ok;
+}
+
+void runFnTest(const Options& options, const SourceManager& sources,
+               const SourceFile* file) {
+  Parser parser{file};
   auto module = parser.parseModule();
   parser.scanToEnd();
+  countParsed(file, module.get());
   for (const auto& diag : parser.diagnostics) {
-    std::cout << diag;
+    printDiagnostic(std::cout, sources, diag);
   }
 
   if (!module) { return; }
   std::cout << *module << '\n';
-  std::cout << source << '\n';
-  module->codegen()->dump();
+  std::cout << file->source << '\n';
+  if (!resolveModule(module.get(), sources, std::cout)) { return; }
+  auto llmodule = codegenModule(*module, options);
+  if (llmodule) { llmodule->dump(); }
 }
 
-int main(int argc, char** argv) {
-  if (argc == 2) {
-    const char* filename = argv[1];
-    std::ifstream file(filename);
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    runFnTest(filename, buffer.str());
+std::unique_ptr<ast::Module> parseFile(const Options& options,
+                                       const SourceManager& sources,
+                                       const SourceFile* file) {
+  std::vector<Diagnostic> diagnostics;
+  auto module = parseModuleParallel(file, options.jobs, &diagnostics);
+  countParsed(file, module.get());
+  for (const auto& diag : diagnostics) {
+    printDiagnostic(std::cerr, sources, diag);
+  }
+  if (module && !resolveModule(module.get(), sources, std::cerr)) {
+    return nullptr;
+  }
+  return module;
+}
+
+// Parse standard input while it's being read, so the output of a program
+// generating Fiddle code can be piped straight in.
+std::unique_ptr<ast::Module> parseStdin(SourceManager* sources) {
+  SourceFile* file = sources->addStreamedFile("<stdin>");
+  assert(file && "standard input must be the only file");
+  SourceStream stream(file, STDIN_FILENO);
+
+  Parser parser{&stream};
+  auto module = parser.parseModule();
+  parser.scanToEnd();
+  countParsed(file, module.get());
+  for (const auto& diag : parser.diagnostics) {
+    printDiagnostic(std::cerr, *sources, diag);
+  }
+
+  if (!stream.error.empty()) {
+    std::cerr << file->filename << ": error: " << stream.error << '\n';
+    return nullptr;
+  }
+  if (module && !resolveModule(module.get(), *sources, std::cerr)) {
+    return nullptr;
+  }
+  return module;
+}
+
+int runModule(const Options& options, const ast::Module& module) {
+  auto llmodule = codegenModule(module, options);
+  if (!llmodule) { return 1; }
+
+  int result;
+  std::string error;
+  if (!runMain(std::move(llmodule), options.programArgs, &result, &error)) {
+    std::cerr << options.filename << ": error: " << error << '\n';
+    return 1;
+  }
+  return result;
+}
+
+// Replace the extension of the input filename (if any) with ".o".
+std::string defaultObjectFilename(const std::string& filename) {
+  if (filename == "-") { return "stdin.o"; }
+  usize slash = filename.rfind('/');
+  usize dot = filename.rfind('.');
+  usize start = slash == std::string::npos ? 0 : slash + 1;
+  if (dot == std::string::npos || dot < start) {
+    return filename.substr(start) + ".o";
+  }
+  return filename.substr(start, dot - start) + ".o";
+}
+
+int buildModule(const Options& options, const ast::Module& module) {
+  std::string error;
+  if (options.compileOnly) {
+    auto llmodule = codegenModule(module, options);
+    if (!llmodule) { return 1; }
+
+    std::string objectFile = options.outputFile ? options.outputFile
+        : defaultObjectFilename(options.filename);
+    if (!emitObjectFile(llmodule.get(), objectFile, options.optLevel,
+                        &error)) {
+      std::cerr << objectFile << ": error: " << error << '\n';
+      return 1;
+    }
     return 0;
   }
 
+  // Emit a temporary object file per partition (just one without -j, or with
+  // the cache) and link them, so the backend runs in parallel too.
+  std::vector<Partition> partitions;
+  std::unique_ptr<llvm::Module> llmodule;
+  std::vector<llvm::Module*> llmodules;
+  if (options.jobs > 1 && !options.cacheDir) {
+    partitions = codegenPartitions(module, options.jobs, options.optLevel);
+    for (const auto& partition : partitions) {
+      llmodules.push_back(partition.module.get());
+    }
+  } else {
+    llmodule = codegenModule(module, options);
+    if (!llmodule) { return 1; }
+    llmodules.push_back(llmodule.get());
+  }
+
+  std::vector<std::string> objectFiles;
+  for (usize i = 0; i < llmodules.size(); ++i) {
+    SmallString<128> tempPath;
+    if (sys::fs::createTemporaryFile("fiddle", "o", tempPath)) {
+      std::cerr << "error: couldn't create temporary object file\n";
+      for (const auto& objectFile : objectFiles) {
+        sys::fs::remove(objectFile);
+      }
+      return 1;
+    }
+    objectFiles.push_back(tempPath.str());
+  }
+
+  std::vector<std::string> errors(llmodules.size());
+  std::vector<char> emitted(llmodules.size());
+  parallelFor(llmodules.size(), options.jobs, [&](usize i) {
+    emitted[i] = emitObjectFile(llmodules[i], objectFiles[i],
+                                options.optLevel, &errors[i]);
+  });
+
+  bool ok = true;
+  for (usize i = 0; i < llmodules.size() && ok; ++i) {
+    if (!emitted[i]) {
+      error = errors[i];
+      ok = false;
+    }
+  }
+  ok = ok && linkExecutable(objectFiles, options.outputFile, &error);
+
+  for (const auto& objectFile : objectFiles) {
+    sys::fs::remove(objectFile);
+  }
+
+  if (!ok) {
+    std::cerr << options.outputFile << ": error: " << error << '\n';
+    return 1;
+  }
+  return 0;
+}
+
+int compileFile(const Options& options) {
+  SourceManager sources;
+  bool build = options.compileOnly || options.outputFile;
+  std::unique_ptr<ast::Module> module;
+
+  if (std::strcmp(options.filename, "-") == 0) {
+    module = parseStdin(&sources);
+  } else {
+    std::string error;
+    const SourceFile* file = sources.loadFile(options.filename, &error);
+    if (!file) {
+      std::cerr << options.filename << ": error: " << error << '\n';
+      return 1;
+    }
+
+    if (!options.run && !build) {
+      runFnTest(options, sources, file);
+      return 0;
+    }
+    module = parseFile(options, sources, file);
+  }
+
+  if (!module) { return 1; }
+  if (options.run) { return runModule(options, *module); }
+  if (build) { return buildModule(options, *module); }
+
+  // Standard input in the default mode: dump what was compiled.
+  std::cout << *module << '\n';
+  auto llmodule = codegenModule(*module, options);
+  if (llmodule) { llmodule->dump(); }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parseArgs(argc, argv, &options)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (options.debugCategories) {
+    std::string error;
+    if (!enableLogCategories(options.debugCategories, &error)) {
+      std::cerr << "error: " << error << '\n';
+      return 1;
+    }
+    if (!FL_LOGGING) {
+      std::cerr << "warning: --debug has no effect, since logging isn't "
+          "compiled in (build with debug=1 or log=1)\n";
+    }
+  }
+
+  if (options.filename) {
+    // Set before anything runs, and so before any other thread starts.
+    compileStats.enabled = options.stats != Options::kNoStats;
+    compileTrace.enabled = options.timeTraceFile != nullptr;
+    compileTrace.granularityNanos = options.timeTraceGranularity * 1000ull;
+
+    int result = compileFile(options);
+    flushLog();
+    if (options.stats == Options::kStatsTable) {
+      compileStats.print(std::cerr);
+    } else if (options.stats == Options::kStatsJSON) {
+      compileStats.printJSON(std::cerr);
+    }
+
+    std::string error;
+    if (options.timeTraceFile &&
+        !compileTrace.write(options.timeTraceFile, &error)) {
+      std::cerr << options.timeTraceFile << ": error: " << error << '\n';
+      return 1;
+    }
+    return result;
+  }
+
   EL editline(argv[0]);
   editline.prompt = "fiddle> ";
 
+  // Each line is added as a file of its own.
+  SourceManager sources;
+
   std::string line;
   while (editline.getLine(&line)) {
     // Strip the newline.
     line.pop_back();
-    runFnTest("<repl>", line);
+    const SourceFile* file = sources.addFile("<repl>", line);
+    if (!file) {
+      std::cerr << "<repl>: error: too much source code\n";
+      return 1;
+    }
+    runFnTest(options, sources, file);
+    // Write out this line's debug log before the next prompt.
+    flushLog();
   }
 
   return 0;
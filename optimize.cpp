@@ -0,0 +1,200 @@
+#include "optimize.h"
+#include "stats.h"
+#include "trace.h"
+#include <llvm/Analysis/CallGraphSCCPass.h>
+#include <llvm/Analysis/Verifier.h>
+#include <llvm/IR/Function.h>
+#include <llvm/Pass.h>
+#include <llvm/PassManager.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <memory>
+#include <vector>
+
+namespace fl {
+
+namespace {
+
+StringRef toStringRef(llvm::StringRef str) {
+  return StringRef{str.data(), str.size()};
+}
+
+// The begin and end markers of one pass share the time it started. A pass
+// manager and its passes are only used by one thread at a time, so this needs
+// no synchronization.
+struct PassTrace {
+  const char* passName;
+  u64 startNanos = 0;
+
+  explicit PassTrace(const char* passName) : passName(passName) {}
+
+  void mark(bool begin, llvm::StringRef detail) {
+    u64 now = monotonicNanos();
+    if (begin) {
+      startNanos = now;
+    } else {
+      compileTrace.record(passName, toStringRef(detail), startNanos, now);
+    }
+  }
+};
+
+struct FunctionMarker : public llvm::FunctionPass {
+  static char ID;
+  PassTrace* trace;
+  bool begin;
+
+  FunctionMarker(PassTrace* trace, bool begin)
+      : llvm::FunctionPass(ID), trace(trace), begin(begin) {}
+
+  const char* getPassName() const override { return "Trace marker"; }
+
+  void getAnalysisUsage(llvm::AnalysisUsage& usage) const override {
+    usage.setPreservesAll();
+  }
+
+  bool runOnFunction(llvm::Function& fn) override {
+    trace->mark(begin, fn.getName());
+    return false;
+  }
+};
+
+struct SCCMarker : public llvm::CallGraphSCCPass {
+  static char ID;
+  PassTrace* trace;
+  bool begin;
+
+  SCCMarker(PassTrace* trace, bool begin)
+      : llvm::CallGraphSCCPass(ID), trace(trace), begin(begin) {}
+
+  const char* getPassName() const override { return "Trace marker"; }
+
+  void getAnalysisUsage(llvm::AnalysisUsage& usage) const override {
+    llvm::CallGraphSCCPass::getAnalysisUsage(usage);
+    usage.setPreservesAll();
+  }
+
+  // Name the event after the first function of the SCC, if it has one (the
+  // external calling node doesn't).
+  bool runOnSCC(llvm::CallGraphSCC& scc) override {
+    llvm::Function* fn = (*scc.begin())->getFunction();
+    trace->mark(begin, fn ? fn->getName() : llvm::StringRef());
+    return false;
+  }
+};
+
+struct ModuleMarker : public llvm::ModulePass {
+  static char ID;
+  PassTrace* trace;
+  bool begin;
+
+  ModuleMarker(PassTrace* trace, bool begin)
+      : llvm::ModulePass(ID), trace(trace), begin(begin) {}
+
+  const char* getPassName() const override { return "Trace marker"; }
+
+  void getAnalysisUsage(llvm::AnalysisUsage& usage) const override {
+    usage.setPreservesAll();
+  }
+
+  bool runOnModule(llvm::Module&) override {
+    trace->mark(begin, llvm::StringRef());
+    return false;
+  }
+};
+
+char FunctionMarker::ID = 0;
+char SCCMarker::ID = 0;
+char ModuleMarker::ID = 0;
+
+// A marker of the same kind as the pass, so it runs in the same pass manager,
+// on the same function or SCC, right before or after the pass. Loop and basic
+// block passes aren't marked (their time counts toward whichever marked pass
+// surrounds them): when such a pass requires a function pass that hasn't run
+// yet, LLVM starts a new loop pass manager for it, which would separate it
+// from its begin marker.
+llvm::Pass* createMarker(const llvm::Pass* pass, PassTrace* trace,
+                         bool begin) {
+  switch (pass->getPassKind()) {
+    case llvm::PT_Function:     return new FunctionMarker(trace, begin);
+    case llvm::PT_CallGraphSCC: return new SCCMarker(trace, begin);
+    case llvm::PT_Module:       return new ModuleMarker(trace, begin);
+    default:                    return nullptr;
+  }
+}
+
+// A pass manager that surrounds each pass added to it (by PassManagerBuilder)
+// with markers recording it as a trace event, when tracing. Otherwise the
+// pipeline is exactly what it would be without tracing.
+template<typename Manager>
+struct TracingPassManager : public Manager {
+  using Manager::Manager; // Inherited constructors.
+
+  void add(llvm::Pass* pass) override {
+    // Immutable passes (alias analyses, target info) don't run per function
+    // or module, so there's nothing to time.
+    if (!compileTrace.enabled || pass->getAsImmutablePass()) {
+      Manager::add(pass);
+      return;
+    }
+
+    auto trace = make_unique<PassTrace>(pass->getPassName());
+    llvm::Pass* begin = createMarker(pass, trace.get(), true);
+    if (!begin) {
+      Manager::add(pass);
+      return;
+    }
+
+    Manager::add(begin);
+    Manager::add(pass);
+    Manager::add(createMarker(pass, trace.get(), false));
+    traces.push_back(std::move(trace));
+  }
+
+ private:
+  // Shared by the markers, which the pass manager owns and deletes.
+  std::vector<std::unique_ptr<PassTrace>> traces;
+};
+
+} // namespace
+
+void optimizeModule(llvm::Module* module, unsigned optLevel, bool inlining) {
+  if (optLevel == 0) { return; }
+  PhaseTimer timer(kPhaseOptimize);
+
+  llvm::PassManagerBuilder builder;
+  builder.OptLevel = optLevel;
+
+  // Match clang: only run the cost-model inliner above -O1. Leaving
+  // builder.Inliner null runs no inliner at all.
+  if (inlining && optLevel > 1) {
+    builder.Inliner = llvm::createFunctionInliningPass(optLevel, 0);
+  } else if (inlining) {
+    builder.Inliner = llvm::createAlwaysInlinerPass();
+  }
+
+  TracingPassManager<llvm::FunctionPassManager> functionPasses(module);
+  builder.populateFunctionPassManager(functionPasses);
+  functionPasses.doInitialization();
+  for (auto& fn : *module) {
+    functionPasses.run(fn);
+  }
+  functionPasses.doFinalization();
+
+  TracingPassManager<llvm::PassManager> modulePasses;
+  builder.populateModulePassManager(modulePasses);
+  modulePasses.run(*module);
+}
+
+void verifyIR(llvm::Module* module) {
+  PhaseTimer timer(kPhaseVerify);
+
+  // A Fiddle module holds nothing but functions, so verifying each definition
+  // checks everything, and lets each show up on its own in a trace.
+  for (auto& fn : *module) {
+    if (fn.isDeclaration()) { continue; }
+    TraceScope trace("VerifyFunction", toStringRef(fn.getName()));
+    llvm::verifyFunction(fn, llvm::AbortProcessAction);
+  }
+}
+
+} // namespace fl
@@ -0,0 +1,33 @@
+#ifndef OPTIMIZE_H_
+#define OPTIMIZE_H_
+
+#include <llvm/IR/Module.h>
+
+namespace fl {
+
+// Run the standard LLVM function and module pass pipelines (mem2reg,
+// instcombine, GVN, inlining, etc.) over the module at the given optimization
+// level, from 0 (no passes) to 3, like a C compiler's -O flags.
+//
+// Without `inlining`, no function is inlined into another, so the code of
+// each function depends only on its own IR and the declarations it calls (as
+// the incremental cache needs, see codegenCached).
+void optimizeModule(llvm::Module* module, unsigned optLevel,
+                    bool inlining = true);
+
+// Whether the driver verifies generated IR. Like the asserts it replaces, this
+// only happens in debug builds.
+#ifdef NDEBUG
+const bool kVerifyIR = false;
+#else
+const bool kVerifyIR = true;
+#endif
+
+// Check that the module's IR is well-formed, printing the problems and
+// aborting if it isn't. Codegen should never produce invalid IR, so this is a
+// check of the compiler, not of the program.
+void verifyIR(llvm::Module* module);
+
+} // namespace fl
+
+#endif /* OPTIMIZE_H_ */
@@ -0,0 +1,98 @@
+#include "optimize.h"
+#include "parallel.h"
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/Linker.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/raw_ostream.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace fl {
+
+unsigned defaultJobs() {
+  unsigned cores = std::thread::hardware_concurrency();
+  return cores == 0 ? 1 : cores;
+}
+
+void parallelFor(usize count, unsigned jobs,
+                 const std::function<void(usize)>& fn) {
+  usize numThreads = std::min<usize>(jobs, count);
+  if (numThreads <= 1) {
+    for (usize i = 0; i < count; ++i) { fn(i); }
+    return;
+  }
+
+  std::atomic<usize> next(0);
+  auto worker = [&]() {
+    for (usize i = next++; i < count; i = next++) { fn(i); }
+  };
+
+  // The calling thread does its share of the work too.
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads - 1);
+  for (usize i = 1; i < numThreads; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) { thread.join(); }
+}
+
+std::vector<Partition> codegenPartitions(const ast::Module& module,
+                                         unsigned jobs,
+                                         unsigned optLevel) {
+  usize numFunctions = module.functions.size();
+  usize numPartitions = std::max<usize>(1, std::min<usize>(jobs,
+                                                           numFunctions));
+  std::vector<Partition> partitions(numPartitions);
+
+  llvm::llvm_start_multithreaded();
+
+  parallelFor(numPartitions, jobs, [&](usize i) {
+    usize begin = numFunctions * i / numPartitions;
+    usize end = numFunctions * (i + 1) / numPartitions;
+    Partition& partition = partitions[i];
+    partition.context = make_unique<llvm::LLVMContext>();
+    partition.module = module.codegen(*partition.context, begin, end);
+    if (kVerifyIR) { verifyIR(partition.module.get()); }
+    optimizeModule(partition.module.get(), optLevel);
+  });
+
+  return partitions;
+}
+
+std::unique_ptr<llvm::Module> linkPartitions(
+    std::vector<Partition> partitions,
+    llvm::LLVMContext& context,
+    std::string* error) {
+  std::vector<std::string> bitcode(partitions.size());
+  parallelFor(partitions.size(), partitions.size(), [&](usize i) {
+    llvm::raw_string_ostream out(bitcode[i]);
+    llvm::WriteBitcodeToFile(partitions[i].module.get(), out);
+    out.flush();
+
+    // Free each partition as soon as it's serialized, module before context.
+    partitions[i].module.reset();
+    partitions[i].context.reset();
+  });
+
+  auto linked = make_unique<llvm::Module>("fiddle", context);
+  llvm::Linker linker(linked.get());
+
+  for (const auto& partitionBitcode : bitcode) {
+    std::unique_ptr<llvm::MemoryBuffer> buffer(
+        llvm::MemoryBuffer::getMemBuffer(partitionBitcode));
+    std::unique_ptr<llvm::Module> partitionModule(
+        llvm::ParseBitcodeFile(buffer.get(), context, error));
+    if (!partitionModule) { return nullptr; }
+    if (linker.linkInModule(partitionModule.get(),
+                            llvm::Linker::DestroySource, error)) {
+      return nullptr;
+    }
+  }
+
+  return linked;
+}
+
+} // namespace fl
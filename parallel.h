@@ -0,0 +1,48 @@
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include "ast.h"
+#include "util.h"
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fl {
+
+// The number of threads to use when the user asks for -j0 (one per core).
+unsigned defaultJobs();
+
+// Call fn(0), fn(1), ..., fn(count - 1) across up to `jobs` threads, each
+// repeatedly claiming the next unclaimed index. Returns when all calls have
+// finished.
+void parallelFor(usize count, unsigned jobs,
+                 const std::function<void(usize)>& fn);
+
+// A slice of a module generated and optimized independently. Each partition
+// owns its LLVMContext so partitions can be processed on separate threads.
+struct Partition {
+  std::unique_ptr<llvm::LLVMContext> context;
+  std::unique_ptr<llvm::Module> module;
+};
+
+// Split the module's functions into up to `jobs` contiguous partitions and
+// generate and optimize them in parallel. Cross-partition calls go through
+// declarations, so inlining only happens within a partition.
+std::vector<Partition> codegenPartitions(const ast::Module& module,
+                                         unsigned jobs,
+                                         unsigned optLevel);
+
+// Merge the partitions into a single module in the given context. LLVM can't
+// link across contexts, so each partition is round-tripped through in-memory
+// bitcode first.
+std::unique_ptr<llvm::Module> linkPartitions(
+    std::vector<Partition> partitions,
+    llvm::LLVMContext& context,
+    std::string* error);
+
+} // namespace fl
+
+#endif /* PARALLEL_H_ */
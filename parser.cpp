@@ -1,5 +1,12 @@
+#include "log.h"
+#include "parallel.h"
 #include "parser.h"
+#include "scan.h"
+#include "stats.h"
+#include "trace.h"
 #include "util.h"
+#include <algorithm>
+#include <iterator>
 #include <string>
 #include <utility>
 
@@ -7,21 +14,34 @@ namespace fl {
 
 using namespace ast;
 
+// Copy the elements pushed onto a scratch stack since `mark` into the arena and
+// pop them off the stack.
+template<typename T>
+Slice<T> popScratch(Arena* arena, std::vector<T>* scratch, usize mark) {
+  assert(mark <= scratch->size());
+  Slice<T> slice = arena->copyArray(scratch->data() + mark,
+                                    scratch->size() - mark);
+  scratch->erase(scratch->begin() + mark, scratch->end());
+  return slice;
+}
+
 std::unique_ptr<Module> Parser::parseModule() {
-  std::vector<std::unique_ptr<Func>> fns;
+  assert(arena && "parseModule can only be called once");
+  PhaseTimer timer(kPhaseParse);
+  std::vector<Func*> fns;
   while (!atEnd()) {
     switch (currToken.kind) {
       case Token::kKeywordFn: {
-        auto fn = parseFuncDef();
+        Func* fn = parseFuncDef();
         if (!fn) { return nullptr; }
-        fns.push_back(std::move(fn));
+        fns.push_back(fn);
         break;
       }
 
       case Token::kKeywordExtern: {
-        auto fn = parseExternFunc();
+        Func* fn = parseExternFunc();
         if (!fn) { return nullptr; }
-        fns.push_back(std::move(fn));
+        fns.push_back(fn);
         break;
       }
 
@@ -30,12 +50,13 @@ std::unique_ptr<Module> Parser::parseModule() {
     }
   }
 
-  return make_unique<Module>(std::move(fns));
+  return make_unique<Module>(std::move(arena), std::move(fns));
 }
 
 // Parse the prototype of a function (its name and arguments).
 // E.g. "fn foo(a: A, b: B, c: C) -> D"
-std::unique_ptr<FuncProto> Parser::parseFuncProto() {
+FuncProto* Parser::parseFuncProto() {
+  SourceLoc start = currToken.location.start;
   if (!expectToken(Token::kKeywordFn)) { return nullptr; }
 
   if (currToken.kind != Token::kIdentifier) {
@@ -43,13 +64,13 @@ std::unique_ptr<FuncProto> Parser::parseFuncProto() {
            currToken);
     return nullptr;
   }
-  std::string functionName = currToken.text().toString();
+  Symbol functionName = currToken.symbol;
   consumeToken();
 
   // Parse arguments.
   if (!expectToken(Token::kParenLeft)) { return nullptr; }
-  std::vector<std::string> argNames;
-  std::vector<std::unique_ptr<Type>> argTypes;
+  usize namesMark = nameScratch.size();
+  usize typesMark = typeScratch.size();
 
   while (true) {
     if (currToken.kind == Token::kParenRight) {
@@ -63,63 +84,67 @@ std::unique_ptr<FuncProto> Parser::parseFuncProto() {
              currToken);
       return nullptr;
     }
-    argNames.push_back(currToken.text().toString());
+    nameScratch.push_back(currToken.symbol);
     consumeToken();
 
     if (!expectToken(Token::kColon)) { return nullptr; }
 
     // Parse argument type.
-    std::unique_ptr<Type> argType = parseType();
+    Type* argType = parseType();
     if (!argType) { return nullptr; }
-    argTypes.push_back(std::move(argType));
+    typeScratch.push_back(argType);
 
     if (currToken.kind == Token::kComma) { consumeToken(); }
   }
 
+  Slice<Symbol> argNames = popScratch(arena.get(), &nameScratch, namesMark);
+  Slice<Type*> argTypes = popScratch(arena.get(), &typeScratch, typesMark);
+
   // Parse return type.
-  std::unique_ptr<Type> returnType;
+  Type* returnType;
   if (currToken.kind == Token::kArrowRight) {
     consumeToken();
     returnType = parseType();
     if (!returnType) { return nullptr; }
   } else {
-    returnType = make_unique<UnitType>();
+    returnType = make<UnitType>(prevTokenEnd());
   }
 
-  return make_unique<FuncProto>(
-      std::move(functionName),
-      std::move(argNames),
-      std::move(argTypes),
-      std::move(returnType));
+  return make<FuncProto>(start, functionName, argNames, argTypes, returnType);
 }
 
-std::unique_ptr<ExternFunc> Parser::parseExternFunc() {
+ExternFunc* Parser::parseExternFunc() {
+  SourceLoc start = currToken.location.start;
   if (!expectToken(Token::kKeywordExtern)) { return nullptr; }
-  std::unique_ptr<FuncProto> proto = parseFuncProto();
+  FuncProto* proto = parseFuncProto();
   if (!proto) { return nullptr; }
-  return make_unique<ExternFunc>(std::move(*proto));
+  return make<ExternFunc>(start, *proto);
 }
 
-std::unique_ptr<FuncDef> Parser::parseFuncDef() {
-  std::unique_ptr<FuncProto> proto = parseFuncProto();
+FuncDef* Parser::parseFuncDef() {
+  TraceScope trace("ParseFunction");
+  FuncProto* proto = parseFuncProto();
   if (!proto) { return nullptr; }
-  std::unique_ptr<Expr> body = parseBlockExpr();
+  trace.setDetail(proto->name);
+  FL_LOG(kLogParse) << "function " << proto->name;
+  Expr* body = parseBlockExpr();
   if (!body) { return nullptr; }
-  return make_unique<FuncDef>(std::move(*proto), std::move(body));
+  return make<FuncDef>(proto->location.start, *proto, body);
 }
 
-std::unique_ptr<Type> Parser::parseType() {
+Type* Parser::parseType() {
+  SourceLoc start = currToken.location.start;
   switch (currToken.kind) {
     case Token::kIdentifier: {
-      std::string typeName = currToken.text().toString();
+      Symbol typeName = currToken.symbol;
       consumeToken();
-      return make_unique<TypeName>(typeName);
+      return make<TypeName>(start, typeName);
     }
 
     case Token::kParenLeft:
       consumeToken();
       if (!expectToken(Token::kParenRight)) { return nullptr; }
-      return make_unique<UnitType>();
+      return make<UnitType>(start);
 
     default:
       report(Diagnostic::kError, "expected type", currToken);
@@ -127,9 +152,10 @@ std::unique_ptr<Type> Parser::parseType() {
   }
 }
 
-std::unique_ptr<Expr> Parser::parseBlockExpr() {
+Expr* Parser::parseBlockExpr() {
+  SourceLoc start = currToken.location.start;
   if (!expectToken(Token::kBraceLeft)) { return nullptr; }
-  std::vector<std::unique_ptr<Expr>> exprs;
+  usize mark = exprScratch.size();
 
   while (true) {
     if (currToken.kind == Token::kBraceRight) {
@@ -137,56 +163,154 @@ std::unique_ptr<Expr> Parser::parseBlockExpr() {
       break;
     }
 
-    std::unique_ptr<Expr> expr = parseExpr();
+    Expr* expr = parseExpr();
     if (!expr) { return nullptr; }
-    exprs.push_back(std::move(expr));
+    exprScratch.push_back(expr);
 
     if (currToken.kind == Token::kSemicolon) { consumeToken(); }
   }
 
-  return make_unique<BlockExpr>(std::move(exprs));
+  return make<BlockExpr>(start, popScratch(arena.get(), &exprScratch, mark));
 }
 
-std::unique_ptr<Expr> Parser::parseExpr() {
-  auto expr = parseExprPrimary();
-  if (!expr) { return nullptr; }
-  return parseExprOperator(std::move(expr), 0);
+// The binary operator for a token kind, if it is one.
+bool getBinOp(Token::TokenKind kind, BinOp* op) {
+  switch (kind) {
+    case Token::kPlus:  *op = kAdd; return true;
+    case Token::kMinus: *op = kSub; return true;
+    case Token::kStar:  *op = kMul; return true;
+    case Token::kSlash: *op = kDiv; return true;
+    default:            return false;
+  }
 }
 
-std::unique_ptr<Expr> Parser::parseExprPrimary() {
-  std::unique_ptr<Expr> expr;
-  Token token = currToken;
+// All binary operators are left-associative.
+const u8 kBinOpPrecedence[kNumBinOps] = {
+  0, // kAdd
+  0, // kSub
+  1, // kMul
+  1, // kDiv
+};
 
-  switch (token.kind) {
-    case Token::kInvalid:
-      report(Diagnostic::kError, "invalid token", token);
-      // Skip past the invalid token and keep trying to parse an expression.
+// Marks an open parenthesis on the operator stack.
+const u8 kOpenParen = kNumBinOps;
+
+// Parse an expression with binary operators and parentheses by
+// operator-precedence (shunting-yard) parsing. Operands are kept on
+// exprScratch and operators on operatorScratch instead of the C stack, so
+// arbitrarily long chains of operators and deeply parenthesized expressions
+// don't recurse.
+Expr* Parser::parseExpr() {
+  usize operandMark = exprScratch.size();
+  usize operatorMark = operatorScratch.size();
+  usize openParens = 0;
+
+  auto fail = [&]() -> Expr* {
+    exprScratch.erase(exprScratch.begin() + operandMark, exprScratch.end());
+    operatorScratch.erase(operatorScratch.begin() + operatorMark,
+                          operatorScratch.end());
+    return nullptr;
+  };
+
+  while (true) {
+    // Expect an operand, possibly preceded by open parentheses.
+    while (true) {
+      if (currToken.kind == Token::kInvalid) {
+        report(Diagnostic::kError, "invalid token", currToken);
+        // Skip past the invalid token and keep trying to parse an expression.
+        consumeToken();
+      } else if (currToken.kind == Token::kParenLeft) {
+        operatorScratch.push_back(kOpenParen);
+        ++openParens;
+        consumeToken();
+      } else {
+        break;
+      }
+    }
+
+    Expr* operand = parseExprPrimary();
+    if (!operand) { return fail(); }
+    exprScratch.push_back(operand);
+
+    // Close any parenthesized subexpressions ending after the operand. A ')'
+    // without a matching '(' in this expression ends the expression instead.
+    while (openParens > 0 && currToken.kind == Token::kParenRight) {
       consumeToken();
-      expr = parseExprPrimary();
-      break;
+      while (operatorScratch.back() != kOpenParen) { reduceBinOp(); }
+      operatorScratch.pop_back();
+      --openParens;
+
+      if (currToken.kind == Token::kParenLeft) {
+        Expr* call = parseCallExpr(exprScratch.back());
+        if (!call) { return fail(); }
+        exprScratch.back() = call;
+      }
+    }
 
+    BinOp op;
+    if (!getBinOp(currToken.kind, &op)) { break; }
+    consumeToken();
+
+    // Everything on the stack binding at least as tightly as this operator
+    // already has its right operand.
+    while (operatorScratch.size() > operatorMark &&
+           operatorScratch.back() != kOpenParen &&
+           kBinOpPrecedence[operatorScratch.back()] >= kBinOpPrecedence[op]) {
+      reduceBinOp();
+    }
+    operatorScratch.push_back(op);
+  }
+
+  if (openParens > 0) {
+    expectToken(Token::kParenRight);
+    return fail();
+  }
+
+  while (operatorScratch.size() > operatorMark) { reduceBinOp(); }
+  assert(exprScratch.size() == operandMark + 1);
+  Expr* expr = exprScratch.back();
+  exprScratch.pop_back();
+  return expr;
+}
+
+// Pop the top operator and its two operands and push the combined expression.
+void Parser::reduceBinOp() {
+  assert(operatorScratch.back() < kNumBinOps && exprScratch.size() >= 2);
+  BinOp op = static_cast<BinOp>(operatorScratch.back());
+  operatorScratch.pop_back();
+  Expr* rhs = exprScratch.back();
+  exprScratch.pop_back();
+  Expr* lhs = exprScratch.back();
+
+  BinOpExpr* expr = arena->make<BinOpExpr>(op, lhs, rhs);
+  expr->location = SourceRange{lhs->location.start, rhs->location.end};
+  exprScratch.back() = expr;
+}
+
+// Parse an integer, variable or block, and a call of it if one follows.
+// Parentheses and operators are handled by parseExpr.
+Expr* Parser::parseExprPrimary() {
+  Expr* expr;
+  Token token = currToken;
+
+  switch (token.kind) {
     case Token::kEOF:
       report(Diagnostic::kError, "unexpected end of file", token);
       return nullptr;
 
     case Token::kInteger:
       consumeToken();
-      expr = make_unique<IntExpr>(token.intValue);
+      expr = make<IntExpr>(token.location.start, token.intValue);
       break;
 
     case Token::kIdentifier:
       consumeToken();
-      expr = make_unique<VarExpr>(token.text().toString());
-      break;
-
-    case Token::kParenLeft:
-      consumeToken();
-      expr = parseExpr();
-      if (!expectToken(Token::kParenRight)) { return nullptr; }
+      expr = make<VarExpr>(token.location.start, token.symbol);
       break;
 
     case Token::kBraceLeft:
       expr = parseBlockExpr();
+      if (!expr) { return nullptr; }
       break;
 
     default:
@@ -194,81 +318,126 @@ std::unique_ptr<Expr> Parser::parseExprPrimary() {
       return nullptr;
   }
 
-  // Parse function call expressions.
   if (currToken.kind == Token::kParenLeft) {
-    consumeToken();
-    std::vector<std::unique_ptr<Expr>> argumentExprs;
+    return parseCallExpr(expr);
+  }
 
-    while (true) {
-      if (currToken.kind == Token::kParenRight) {
-        consumeToken();
-        break;
-      }
-      auto argumentExpr = parseExpr();
-      if (!argumentExpr) { return nullptr; }
-      argumentExprs.push_back(std::move(argumentExpr));
-      if (currToken.kind == Token::kComma) { consumeToken(); }
-    }
+  return expr;
+}
 
-    return make_unique<CallExpr>(std::move(expr), std::move(argumentExprs));
+// Parse the argument list of a call of `functionExpr`.
+Expr* Parser::parseCallExpr(Expr* functionExpr) {
+  if (!expectToken(Token::kParenLeft)) { return nullptr; }
+  usize mark = exprScratch.size();
+
+  while (true) {
+    if (currToken.kind == Token::kParenRight) {
+      consumeToken();
+      break;
+    }
+    Expr* argumentExpr = parseExpr();
+    if (!argumentExpr) {
+      exprScratch.erase(exprScratch.begin() + mark, exprScratch.end());
+      return nullptr;
+    }
+    exprScratch.push_back(argumentExpr);
+    if (currToken.kind == Token::kComma) { consumeToken(); }
   }
 
-  return expr;
+  return make<CallExpr>(functionExpr->location.start, functionExpr,
+                        popScratch(arena.get(), &exprScratch, mark));
 }
 
-const std::map<std::string, u8> kPrecedenceTable{
-  {"+", 0},
-  {"-", 0},
-  {"*", 1},
-  {"/", 1},
-};
+Token Parser::consumeToken() {
+  assert(!atEnd());
+  loadToken(tokenIndex + 1);
+  return currToken;
+}
 
-bool getPrecedence(const std::string& binOp, u8* precedence) {
-  auto it = kPrecedenceTable.find(binOp);
-  if (it == kPrecedenceTable.end()) { return false; }
-  *precedence = it->second;
-  return true;
+Token::TokenKind Parser::peekKind(usize n) {
+  usize index = tokenIndex + n;
+  fillTokens(index);
+  return index < tokens.size() ? tokens.kind(index) : Token::kEOF;
 }
 
-std::unique_ptr<Expr> Parser::parseExprOperator(std::unique_ptr<Expr> lhs,
-                                                u8 minPrecedence) {
-  while (!atEnd()) {
-    std::string op = currToken.text().toString();
-    u8 precedence;
-    if (currToken.kind != Token::kOperator ||
-        !getPrecedence(op, &precedence) ||
-        precedence < minPrecedence) {
-      break;
+void Parser::reset(usize mark) {
+  assert(mark <= tokenIndex);
+  loadToken(mark);
+}
+
+// Lex (or receive from the lexer thread) tokens until the buffer holds the
+// token at `index` or ends with EOF.
+void Parser::fillTokens(usize index) {
+  while (index >= tokens.size() &&
+         (tokens.size() == 0 ||
+          tokens.kind(tokens.size() - 1) != Token::kEOF)) {
+    if (tokenRing) {
+      receiveTokens();
+    } else {
+      tokens.push(lexer.nextToken());
     }
-    consumeToken();
+  }
+}
 
-    auto rhs = parseExprPrimary();
-    if (!rhs) { return nullptr; }
+Parser::~Parser() {
+  if (compileStats.enabled) { compileStats.tokens += tokens.size(); }
 
-    while (!atEnd()) {
-      std::string op2 = currToken.text().toString();
-      u8 precedence2;
-      if (currToken.kind != Token::kOperator ||
-          !getPrecedence(op2, &precedence2) ||
-          precedence2 <= precedence) {
-        break;
-      }
+  // If parsing stopped early the lexer may still be waiting for space in the
+  // ring.
+  cancelLexer.store(true, std::memory_order_relaxed);
+  stopLexerThread();
+}
 
-      rhs = parseExprOperator(std::move(rhs), precedence2);
-      if (!rhs) { return nullptr; }
+void Parser::runLexerThread() {
+  PhaseTimer timer(kPhaseLex);
+  Token token;
+  do {
+    token = lexer.nextToken();
+    while (!tokenRing->tryPush(token)) {
+      if (cancelLexer.load(std::memory_order_relaxed)) { return; }
+      std::this_thread::yield();
     }
+  } while (token.kind != Token::kEOF);
+}
 
-    lhs = make_unique<BinOpExpr>(op, std::move(lhs), std::move(rhs));
+// Wait for at least one token from the lexer thread and move every available
+// token into the buffer.
+void Parser::receiveTokens() {
+  const usize kBatchSize = 64;
+  Token batch[kBatchSize];
+  usize count;
+  while ((count = tokenRing->tryPopMany(batch, kBatchSize)) == 0) {
+    std::this_thread::yield();
   }
 
-  return lhs;
+  for (usize i = 0; i < count; ++i) {
+    tokens.push(batch[i]);
+  }
+
+  if (batch[count - 1].kind == Token::kEOF) {
+    stopLexerThread();
+    diagnostics.insert(diagnostics.begin(), lexerDiagnostics.begin(),
+                       lexerDiagnostics.end());
+    lexerDiagnostics.clear();
+  }
 }
 
-Token Parser::consumeToken() {
-  assert(!atEnd());
-  currToken = lexer.nextToken();
-  std::cerr << "token: " << currToken << '\n';
-  return currToken;
+void Parser::stopLexerThread() {
+  if (lexerThread.joinable()) { lexerThread.join(); }
+}
+
+// How many consumed tokens a streamed parse keeps before discarding them.
+const usize kStreamedTokenHistory = 4096;
+
+void Parser::loadToken(usize index) {
+  fillTokens(index);
+  assert(index >= tokens.firstIndex && index < tokens.size());
+  if (lexer.stream && index - tokens.firstIndex > kStreamedTokenHistory) {
+    // Keep the previous token for prevTokenEnd.
+    tokens.discardBefore(index - 1);
+  }
+  tokenIndex = index;
+  currToken = tokens.get(index);
 }
 
 bool Parser::atEnd() const {
@@ -296,4 +465,130 @@ void Parser::report(Diagnostic::DiagnosticLevel level, StringRef message,
       Diagnostic{level, message.toString(), token.location});
 }
 
+// Find where to split the source into about `count` chunks of similar size.
+// Each chunk begins at a top-level item, i.e. an `fn` or `extern` keyword
+// outside of any braces (an `fn` right after `extern` is part of the same
+// item). This is a rough scan of the characters rather than the tokens, but
+// since Fiddle has no strings or comments, braces and keywords can't appear
+// anywhere else. Returns the offsets the chunks begin at, starting with 0.
+std::vector<usize> findChunkBoundaries(StringRef source, usize count) {
+  std::vector<usize> boundaries{0};
+  usize nextSplit = source.length / count;
+  usize depth = 0;
+  bool afterExtern = false;
+
+  const char* begin = source.data;
+  const char* end = begin + source.length;
+  const char* p = begin;
+  while (p != end && boundaries.size() < count) {
+    char c = *p;
+    if (hasClass(c, kWhitespaceChar)) {
+      ++p;
+      continue;
+    }
+
+    if (!hasClass(c, kIdentifierChar)) {
+      if (c == '{') {
+        ++depth;
+      } else if (c == '}' && depth > 0) {
+        --depth;
+      }
+      afterExtern = false;
+      ++p;
+      continue;
+    }
+
+    const char* wordStart = p;
+    while (p != end && hasClass(*p, kIdentifierChar)) { ++p; }
+    if (depth != 0) { continue; }
+
+    StringRef word{wordStart, static_cast<usize>(p - wordStart)};
+    usize offset = wordStart - begin;
+    bool itemStart = word == "extern" || (word == "fn" && !afterExtern);
+    if (itemStart && offset >= nextSplit) {
+      boundaries.push_back(offset);
+      nextSplit = source.length * boundaries.size() / count;
+    }
+    afterExtern = word == "extern";
+  }
+
+  return boundaries;
+}
+
+// Chunks smaller than this aren't worth a parser of their own.
+const usize kMinParseChunkSize = 64 * 1024;
+
+std::unique_ptr<Module> parseModuleParallel(
+    const SourceFile* file,
+    unsigned jobs,
+    std::vector<Diagnostic>* diagnostics) {
+  // A few chunks per thread, so a chunk that happens to be slow to parse
+  // doesn't hold up the rest.
+  usize size = file->source.length;
+  usize numChunks = jobs <= 1 ? 1 : std::max<usize>(
+      1, std::min<usize>(jobs * 4, size / kMinParseChunkSize));
+  std::vector<usize> boundaries = findChunkBoundaries(file->source, numChunks);
+  boundaries.push_back(size);
+  numChunks = boundaries.size() - 1;
+
+  // With a single chunk, the lexer thread is the only parallelism left.
+  Parser::LexMode mode = Parser::kLexUpFront;
+  if (numChunks == 1 && jobs > 1 && size >= kPipelinedLexingThreshold) {
+    mode = Parser::kLexPipelined;
+  }
+
+  struct ChunkResult {
+    std::unique_ptr<Module> module;
+    std::vector<Diagnostic> diagnostics;
+    // How many of `diagnostics`, at the front, came from the lexer.
+    usize numLexerDiagnostics;
+  };
+  std::vector<ChunkResult> results(numChunks);
+
+  parallelFor(numChunks, jobs, [&](usize i) {
+    Parser parser(file, boundaries[i], boundaries[i + 1], mode);
+    // Lexing up front has already reported all of the lexer's diagnostics.
+    // (Pipelined lexing is only used for a single chunk, so its count doesn't
+    // matter.)
+    results[i].numLexerDiagnostics = parser.diagnostics.size();
+    results[i].module = parser.parseModule();
+    parser.scanToEnd();
+    results[i].diagnostics = std::move(parser.diagnostics);
+  });
+
+  // Report the diagnostics as parsing the whole file in one chunk would: all
+  // of the lexer's first, then the parser's up to its first syntax error,
+  // after which it stops. So parser diagnostics are dropped past the first
+  // chunk that failed.
+  auto arena = make_unique<Arena>();
+  std::vector<Func*> functions;
+  std::vector<Diagnostic> parserDiagnostics;
+  bool ok = true;
+  for (auto& result : results) {
+    auto lexerEnd = result.diagnostics.begin() + result.numLexerDiagnostics;
+    diagnostics->insert(diagnostics->end(),
+                        std::make_move_iterator(result.diagnostics.begin()),
+                        std::make_move_iterator(lexerEnd));
+    if (ok) {
+      parserDiagnostics.insert(parserDiagnostics.end(),
+                               std::make_move_iterator(lexerEnd),
+                               std::make_move_iterator(
+                                   result.diagnostics.end()));
+    }
+    if (!result.module) {
+      ok = false;
+      continue;
+    }
+    arena->adopt(result.module->arena.get());
+    functions.insert(functions.end(), result.module->functions.begin(),
+                     result.module->functions.end());
+  }
+  diagnostics->insert(diagnostics->end(),
+                      std::make_move_iterator(parserDiagnostics.begin()),
+                      std::make_move_iterator(parserDiagnostics.end()));
+
+  if (!ok) { return nullptr; }
+  return make_unique<Module>(std::move(arena), std::move(functions));
+}
+
 } // namespace fl
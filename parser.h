@@ -1,11 +1,15 @@
 #ifndef PARSER_H_
 #define PARSER_H_
 
+#include "arena.h"
 #include "ast.h"
 #include "diagnostic.h"
 #include "lexer.h"
+#include "ring.h"
+#include <atomic>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 #include <unordered_map>
 #include <utility>
@@ -13,39 +17,162 @@
 namespace fl {
 
 struct Parser {
-  std::shared_ptr<SourceFile> sourceFile;
+  // When tokens are lexed. On demand, each token is lexed as the parser reaches
+  // it (or looks ahead to it), interleaving lexer and parser diagnostics. Up
+  // front, the whole file is lexed into the token buffer before parsing starts.
+  // Pipelined, the lexer runs ahead on a thread of its own while the parser
+  // consumes its tokens, which pays off for large files. In the last two
+  // modes, lexer diagnostics come before all parser diagnostics.
+  enum LexMode {
+    kLexOnDemand,
+    kLexUpFront,
+    kLexPipelined,
+  };
+
+  const SourceFile* sourceFile;
   std::vector<Diagnostic> diagnostics;
+
+  // In pipelined mode, the lexer reports here until it reaches the end of the
+  // file, and these are then moved to the front of `diagnostics`.
+  std::vector<Diagnostic> lexerDiagnostics;
+
   Lexer lexer;
+
+  // Every token lexed so far. The parser reads tokens from here by index, so it
+  // can look any distance ahead and backtrack to any earlier token.
+  TokenBuffer tokens;
+  usize tokenIndex = 0;
+
+  // A copy of tokens[tokenIndex].
   Token currToken;
 
-  explicit Parser(SourceFile file)
-      : sourceFile(std::make_shared<SourceFile>(std::move(file))),
+  // In pipelined mode, the lexer thread and the queue it publishes tokens to.
+  // The ring is large enough that the lexer rarely waits for the parser.
+  typedef SpscRing<Token, 4096> TokenRing;
+  std::unique_ptr<TokenRing> tokenRing;
+  std::thread lexerThread;
+  std::atomic<bool> cancelLexer{false};
+
+  // Every AST node is allocated here. The arena is handed over to the Module
+  // returned by parseModule.
+  std::unique_ptr<Arena> arena;
+
+  // Stacks for collecting the elements of lists while they're parsed, before
+  // they're copied into the arena. Nested lists push on top of the enclosing
+  // list's elements, so the buffers are reused instead of reallocated.
+  std::vector<ast::Expr*> exprScratch;
+  std::vector<Symbol> nameScratch;
+  std::vector<ast::Type*> typeScratch;
+
+  // The operator stack of parseExpr: binary operators waiting for their right
+  // operand, and open parentheses.
+  std::vector<u8> operatorScratch;
+
+  // The file is owned by a SourceManager, which must outlive the parser.
+  explicit Parser(const SourceFile* file, LexMode mode = kLexOnDemand)
+      : Parser(file, 0, file->source.length, mode) {}
+
+  // Parse a streamed file as it's read. Tokens are lexed on demand, and
+  // consumed tokens are discarded along the way, so a streamed parse can't
+  // backtrack far.
+  explicit Parser(SourceStream* stream)
+      : sourceFile(stream->file),
+        diagnostics(),
+        lexerDiagnostics(),
+        lexer(stream, diagnostics),
+        arena(make_unique<Arena>()) {
+    // Initialize currToken.
+    loadToken(0);
+  }
+
+  // Parse only the bytes in [begin, end) of the file, as if the rest didn't
+  // exist.
+  Parser(const SourceFile* file, usize begin, usize end,
+         LexMode mode = kLexOnDemand)
+      : sourceFile(file),
         diagnostics(),
-        lexer(sourceFile, diagnostics) {
+        lexerDiagnostics(),
+        lexer(sourceFile,
+              mode == kLexPipelined ? lexerDiagnostics : diagnostics,
+              begin, end),
+        arena(make_unique<Arena>()) {
+    if (mode == kLexUpFront) {
+      lexer.lexAll(&tokens);
+    } else if (mode == kLexPipelined) {
+      tokenRing = make_unique<TokenRing>();
+      lexerThread = std::thread(&Parser::runLexerThread, this);
+    }
     // Initialize currToken.
-    consumeToken();
+    loadToken(0);
   }
 
+  ~Parser();
+
   std::unique_ptr<ast::Module> parseModule();
-  std::unique_ptr<ast::FuncProto> parseFuncProto();
-  std::unique_ptr<ast::FuncDef> parseFuncDef();
-  std::unique_ptr<ast::ExternFunc> parseExternFunc();
-  std::unique_ptr<ast::Type> parseType();
-  std::unique_ptr<ast::Expr> parseExpr();
-  std::unique_ptr<ast::Expr> parseExprPrimary();
-  std::unique_ptr<ast::Expr> parseExprOperator(std::unique_ptr<ast::Expr> lhs,
-                                               u8 minPrecedence);
-  std::unique_ptr<ast::Expr> parseBlockExpr();
+  ast::FuncProto* parseFuncProto();
+  ast::FuncDef* parseFuncDef();
+  ast::ExternFunc* parseExternFunc();
+  ast::Type* parseType();
+  ast::Expr* parseExpr();
+  ast::Expr* parseExprPrimary();
+  ast::Expr* parseCallExpr(ast::Expr* functionExpr);
+  void reduceBinOp();
+  ast::Expr* parseBlockExpr();
 
   Token nextToken();
   Token consumeToken();
+
+  // The kind of the token `n` tokens after the current one (0 is the current
+  // token). Past the end of the file it's kEOF.
+  Token::TokenKind peekKind(usize n);
+
+  // Save the position in the token stream, and return to a saved position to
+  // backtrack. Diagnostics and scratch stacks aren't rolled back, so a
+  // speculative parse shouldn't report or push anything it might undo.
+  usize mark() const { return tokenIndex; }
+  void reset(usize mark);
+
+  // The end of the last consumed token, which is where a node being parsed
+  // ends.
+  SourceLoc prevTokenEnd() const {
+    return tokenIndex == 0 ? currToken.location.start
+        : tokens.location(tokenIndex - 1).end;
+  }
+
+  void fillTokens(usize index);
+  void loadToken(usize index);
+  void runLexerThread();
+  void receiveTokens();
+  void stopLexerThread();
   bool atEnd() const;
   void scanToEnd();
   bool expectToken(Token::TokenKind expected);
   void report(Diagnostic::DiagnosticLevel level, StringRef message,
               const Token& token);
+
+  // Allocate a node spanning from `start` to the end of the last consumed
+  // token.
+  template<typename T, typename... Args>
+  T* make(SourceLoc start, Args&&... args) {
+    T* node = arena->make<T>(std::forward<Args>(args)...);
+    node->location = SourceRange{start, prevTokenEnd()};
+    return node;
+  }
 };
 
+// Files at least this large are worth lexing on a separate thread.
+const usize kPipelinedLexingThreshold = 1 << 20;
+
+// Parse the file with up to `jobs` threads. The file is split into chunks at
+// the starts of top-level items, each chunk is parsed separately, and the
+// functions of the chunks are merged in source order. Appends the same
+// diagnostics to *diagnostics as parsing the file in one chunk, whatever the
+// number of chunks, and returns nullptr if any chunk failed to parse.
+std::unique_ptr<ast::Module> parseModuleParallel(
+    const SourceFile* file,
+    unsigned jobs,
+    std::vector<Diagnostic>* diagnostics);
+
 } // namespace fl
 
 #endif /* PARSER_H */
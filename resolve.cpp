@@ -0,0 +1,143 @@
+#include "resolve.h"
+#include "stats.h"
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace fl {
+
+using namespace ast;
+
+namespace {
+
+struct Resolver : public Visitor<Resolver> {
+  const std::vector<Func*>* functions;
+  std::unordered_map<Symbol, u32> functionIndices;
+  type::TypeContext* types;
+  std::vector<Diagnostic>* diagnostics;
+  bool ok = true;
+
+  // The arguments of the function being resolved.
+  Slice<Symbol> argNames;
+
+  void error(const std::string& message, SourceRange location) {
+    diagnostics->emplace_back(
+        Diagnostic{Diagnostic::kError, message, location});
+    ok = false;
+  }
+
+  // Bind the name, looking through the arguments before the functions.
+  // Returns false if it's undefined.
+  bool bind(VarExpr* var) {
+    // Functions take a handful of arguments, so a scan beats hashing. Later
+    // arguments shadow earlier ones with the same name.
+    for (usize i = argNames.size(); i-- > 0;) {
+      if (argNames[i] == var->name) {
+        var->binding = VarExpr::kArgument;
+        var->index = i;
+        return true;
+      }
+    }
+
+    auto it = functionIndices.find(var->name);
+    if (it == functionIndices.end()) {
+      error("undefined name '" + var->name.str().toString() + "'",
+            var->location);
+      return false;
+    }
+    var->binding = VarExpr::kFunction;
+    var->index = it->second;
+    return true;
+  }
+
+  void visitTypeName(TypeName* type) {
+    type->resolvedType = types->namedType(type->name);
+    if (!type->resolvedType) {
+      error("unknown type '" + type->name.str().toString() + "'",
+            type->location);
+    }
+  }
+
+  void visitUnitType(UnitType* type) {
+    type->resolvedType = types->unitType();
+  }
+
+  // Bodies are resolved in pre-order (see Visitor::walkPreOrder), so a call
+  // is visited right before its function expression.
+  const CallExpr* currentCall = nullptr;
+
+  void visitVarExpr(VarExpr* var) {
+    bool isCallee = currentCall && var == currentCall->functionExpr;
+    if (!bind(var)) { return; }
+
+    if (!isCallee) {
+      if (var->binding == VarExpr::kFunction) {
+        error("function '" + var->name.str().toString() +
+              "' can't be used as a value", var->location);
+      }
+      return;
+    }
+
+    if (var->binding != VarExpr::kFunction) {
+      error("'" + var->name.str().toString() + "' is not a function",
+            var->location);
+      return;
+    }
+    usize numArgs = currentCall->argumentExprs.size();
+    usize numParams = (*functions)[var->index]->proto.argNames.size();
+    if (numArgs != numParams) {
+      error("'" + var->name.str().toString() + "' takes " +
+            std::to_string(numParams) + " argument" +
+            (numParams == 1 ? "" : "s") + " but is called with " +
+            std::to_string(numArgs), currentCall->location);
+    }
+  }
+
+  void visitCallExpr(CallExpr* call) {
+    currentCall = call;
+    if (!isa<VarExpr>(call->functionExpr)) {
+      error("only functions can be called, by name",
+            call->functionExpr->location);
+    }
+  }
+};
+
+} // namespace
+
+bool resolveNames(Module* module, std::vector<Diagnostic>* diagnostics) {
+  PhaseTimer timer(kPhaseResolve);
+  Resolver resolver;
+  resolver.functions = &module->functions;
+  resolver.types = &module->types;
+  resolver.diagnostics = diagnostics;
+
+  // Codegen would have to rename a second function of the same name, and
+  // functions compiled separately (see codegenCached) couldn't be linked.
+  resolver.functionIndices.reserve(module->functions.size());
+  for (usize i = 0; i < module->functions.size(); ++i) {
+    const FuncProto& proto = module->functions[i]->proto;
+    auto inserted = resolver.functionIndices.emplace(proto.name, i);
+    if (!inserted.second) {
+      resolver.error("redefinition of function '" +
+                     proto.name.str().toString() + "'", proto.location);
+      const Func* previous = module->functions[inserted.first->second];
+      diagnostics->emplace_back(
+          Diagnostic{Diagnostic::kInfo, "previous definition is here",
+                     previous->proto.location});
+    }
+  }
+
+  for (Func* fn : module->functions) {
+    for (Type* argType : fn->proto.argTypes) { resolver.visit(argType); }
+    resolver.visit(fn->proto.returnType);
+
+    if (auto def = dynCast<FuncDef>(fn)) {
+      resolver.argNames = def->proto.argNames;
+      resolver.walkPreOrder(def->body);
+    }
+  }
+
+  return resolver.ok;
+}
+
+} // namespace fl
@@ -0,0 +1,21 @@
+#ifndef RESOLVE_H_
+#define RESOLVE_H_
+
+#include "ast.h"
+#include "diagnostic.h"
+#include <vector>
+
+namespace fl {
+
+// Bind every name in the module to what it refers to (see VarExpr::binding),
+// so codegen can look values up by index, and resolve every type expression
+// to a type of the module's TypeContext. An argument shadows a function of
+// the same name. Reports functions defined or declared more than once,
+// undefined names and types, calls to things that aren't functions or with
+// the wrong number of arguments, and functions used as values. Returns false
+// if there were any errors, in which case the module can't be compiled.
+bool resolveNames(ast::Module* module, std::vector<Diagnostic>* diagnostics);
+
+} // namespace fl
+
+#endif /* RESOLVE_H_ */
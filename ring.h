@@ -0,0 +1,80 @@
+#ifndef RING_H_
+#define RING_H_
+
+#include "util.h"
+#include <atomic>
+
+namespace fl {
+
+/*
+ * A fixed-size lock-free queue between exactly one producer thread and one
+ * consumer thread. The producer only writes `tail` and the consumer only writes
+ * `head`, so each side publishes with a single release store and no locks or
+ * read-modify-write operations are needed. Each side also keeps a stale copy
+ * of the other's index and only reloads it when the ring looks full (or
+ * empty), which keeps the shared cache lines from bouncing on every element.
+ *
+ * Capacity must be a power of two. One slot is always left empty to tell a
+ * full ring from an empty one.
+ */
+template<typename T, usize Capacity>
+struct SpscRing {
+  static_assert((Capacity & (Capacity - 1)) == 0,
+                "ring capacity must be a power of two");
+
+  // Producer side. Returns false if the ring is full.
+  bool tryPush(const T& value) {
+    usize tail = producer.tail.load(std::memory_order_relaxed);
+    usize next = (tail + 1) & (Capacity - 1);
+    if (next == producer.cachedHead) {
+      producer.cachedHead = consumer.head.load(std::memory_order_acquire);
+      if (next == producer.cachedHead) { return false; }
+    }
+    slots[tail] = value;
+    producer.tail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Pops up to `max` elements into `out` and returns how many
+  // were popped (0 if the ring is empty).
+  usize tryPopMany(T* out, usize max) {
+    usize head = consumer.head.load(std::memory_order_relaxed);
+    if (head == consumer.cachedTail) {
+      consumer.cachedTail = producer.tail.load(std::memory_order_acquire);
+      if (head == consumer.cachedTail) { return 0; }
+    }
+
+    usize count = 0;
+    while (count < max && head != consumer.cachedTail) {
+      out[count++] = slots[head];
+      head = (head + 1) & (Capacity - 1);
+    }
+    consumer.head.store(head, std::memory_order_release);
+    return count;
+  }
+
+ private:
+  // The two sides are padded a cache line apart to avoid false sharing.
+  // Padding rather than alignas, since C++11 `new` doesn't honor alignments
+  // beyond the default.
+  static const usize kCacheLineSize = 64;
+
+  struct ProducerSide {
+    std::atomic<usize> tail{0};
+    usize cachedHead = 0;
+    char padding[kCacheLineSize - 2 * sizeof(usize)];
+  };
+  struct ConsumerSide {
+    std::atomic<usize> head{0};
+    usize cachedTail = 0;
+    char padding[kCacheLineSize - 2 * sizeof(usize)];
+  };
+
+  ProducerSide producer;
+  ConsumerSide consumer;
+  T slots[Capacity];
+};
+
+} // namespace fl
+
+#endif /* RING_H_ */
@@ -0,0 +1,171 @@
+#include "scan.h"
+
+#ifdef FL_SCAN_X86
+#include <cpuid.h>
+#include <emmintrin.h>
+#endif
+
+namespace fl {
+
+constexpr bool containsChar(const char* str, int c) {
+  return *str != '\0' && (*str == c || containsChar(str + 1, c));
+}
+
+constexpr u8 classifyChar(int c) {
+  return ((c >= '0' && c <= '9') ? kDigitChar | kIdentifierChar : 0)
+      | (((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_')
+         ? kIdentifierChar : 0)
+      | (containsChar("~!@#$%^&*-+=|/?<>.", c) ? kOperatorChar : 0)
+      | (containsChar(" \t\r\n", c) ? kWhitespaceChar : 0);
+}
+
+#define CLASSIFY4(c) classifyChar(c), classifyChar(c + 1), \
+    classifyChar(c + 2), classifyChar(c + 3)
+#define CLASSIFY16(c) CLASSIFY4(c), CLASSIFY4(c + 4), CLASSIFY4(c + 8), \
+    CLASSIFY4(c + 12)
+#define CLASSIFY64(c) CLASSIFY16(c), CLASSIFY16(c + 16), CLASSIFY16(c + 32), \
+    CLASSIFY16(c + 48)
+
+// Computed at compile time.
+const u8 kCharClasses[256] = {
+  CLASSIFY64(0), CLASSIFY64(64), CLASSIFY64(128), CLASSIFY64(192)
+};
+
+#undef CLASSIFY64
+#undef CLASSIFY16
+#undef CLASSIFY4
+
+// Scalar kernels, also used for the tails shorter than a vector.
+
+const char* skipClassScalar(const char* p, const char* end, u8 charClass) {
+  while (p != end && hasClass(*p, charClass)) { ++p; }
+  return p;
+}
+
+const char* skipWhitespaceScalar(const char* p, const char* end) {
+  return skipClassScalar(p, end, kWhitespaceChar);
+}
+
+const char* skipIdentifierCharsScalar(const char* p, const char* end) {
+  return skipClassScalar(p, end, kIdentifierChar);
+}
+
+void findNewlinesScalar(const char* base, const char* p, const char* end,
+                        std::vector<usize>* offsets) {
+  for (; p != end; ++p) {
+    if (*p == '\n') { offsets->push_back(p - base); }
+  }
+}
+
+const ScanKernels kScalarScanKernels{
+  skipWhitespaceScalar, skipIdentifierCharsScalar, findNewlinesScalar, "scalar"
+};
+
+#ifdef FL_SCAN_X86
+
+// The SSE2 kernels compute a 16-bit mask with a bit set for each byte of the
+// vector in the class, then look for the first byte that isn't.
+
+inline __m128i whitespaceBytes128(__m128i v) {
+  return _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                   _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))),
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')),
+                   _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+}
+
+// Bytes >= 0x80 are negative in the signed comparisons, so they never fall in
+// the ranges below.
+inline __m128i identifierBytes128(__m128i v) {
+  // Setting bit 5 folds 'A'-'Z' onto 'a'-'z' without mapping anything else
+  // into that range.
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i alpha = _mm_and_si128(
+      _mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+      _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower));
+  __m128i digit = _mm_and_si128(
+      _mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+      _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), v));
+  __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+  return _mm_or_si128(_mm_or_si128(alpha, digit), underscore);
+}
+
+template<__m128i (*inClass)(__m128i)>
+const char* skipClassSSE2(const char* p, const char* end, u8 charClass) {
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    u32 outside = ~_mm_movemask_epi8(inClass(v)) & 0xFFFF;
+    if (outside) { return p + __builtin_ctz(outside); }
+    p += 16;
+  }
+  return skipClassScalar(p, end, charClass);
+}
+
+const char* skipWhitespaceSSE2(const char* p, const char* end) {
+  return skipClassSSE2<whitespaceBytes128>(p, end, kWhitespaceChar);
+}
+
+const char* skipIdentifierCharsSSE2(const char* p, const char* end) {
+  return skipClassSSE2<identifierBytes128>(p, end, kIdentifierChar);
+}
+
+void findNewlinesSSE2(const char* base, const char* p, const char* end,
+                      std::vector<usize>* offsets) {
+  const __m128i newline = _mm_set1_epi8('\n');
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    u32 mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, newline));
+    while (mask) {
+      offsets->push_back(p - base + __builtin_ctz(mask));
+      mask &= mask - 1;
+    }
+    p += 16;
+  }
+  findNewlinesScalar(base, p, end, offsets);
+}
+
+const ScanKernels kSSE2ScanKernels{
+  skipWhitespaceSSE2, skipIdentifierCharsSSE2, findNewlinesSSE2, "sse2"
+};
+
+void appendMaskOffsets(usize offset, u32 mask, std::vector<usize>* offsets) {
+  while (mask) {
+    offsets->push_back(offset + __builtin_ctz(mask));
+    mask &= mask - 1;
+  }
+}
+
+// CPUID leaf 1 ECX and leaf 7 EBX feature bits.
+const u32 kCpuidAVX     = 1 << 28;
+const u32 kCpuidOSXSAVE = 1 << 27;
+const u32 kCpuidAVX2    = 1 << 5;
+
+bool cpuSupportsAVX2() {
+  unsigned eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) { return false; }
+  if (!(ecx & kCpuidAVX) || !(ecx & kCpuidOSXSAVE)) { return false; }
+
+  // The OS must also save the SSE and AVX registers (XCR0 bits 1 and 2) on
+  // context switches, or using them corrupts other threads' state.
+  u32 xcr0, xcr0High;
+  __asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0High) : "c"(0));
+  if ((xcr0 & 0x6) != 0x6) { return false; }
+
+  if (__get_cpuid_max(0, nullptr) < 7) { return false; }
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  return ebx & kCpuidAVX2;
+}
+
+#endif // FL_SCAN_X86
+
+ScanKernels selectScanKernels() {
+#ifdef FL_SCAN_X86
+  return cpuSupportsAVX2() ? kAVX2ScanKernels : kSSE2ScanKernels;
+#else
+  return kScalarScanKernels;
+#endif
+}
+
+const ScanKernels kScanKernels = selectScanKernels();
+
+} // namespace fl
@@ -0,0 +1,71 @@
+#ifndef SCAN_H_
+#define SCAN_H_
+
+#include "util.h"
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define FL_SCAN_X86 1
+#endif
+
+namespace fl {
+
+// Character classes, combined as bit flags in kCharClasses.
+enum CharClass : u8 {
+  kDigitChar      = 1 << 0,
+  kIdentifierChar = 1 << 1,
+  kOperatorChar   = 1 << 2,
+  kWhitespaceChar = 1 << 3,
+};
+
+// The classes of every byte. Bytes outside of ASCII belong to no class.
+extern const u8 kCharClasses[256];
+
+inline bool hasClass(char c, u8 charClass) {
+  return kCharClasses[static_cast<u8>(c)] & charClass;
+}
+
+/*
+ * Kernels for skipping long runs of a character class and indexing newlines.
+ * They process 16 (SSE2) or 32 (AVX2) bytes at a time where the CPU supports
+ * it, chosen once at startup, and fall back to a byte at a time otherwise.
+ */
+struct ScanKernels {
+  // Return the first byte in [p, end) that isn't whitespace, or end.
+  const char* (*skipWhitespace)(const char* p, const char* end);
+
+  // Return the first byte in [p, end) that isn't an identifier character
+  // ([A-Za-z0-9_]), or end.
+  const char* (*skipIdentifierChars)(const char* p, const char* end);
+
+  // Append the offset from `base` of every '\n' in [p, end) to *offsets.
+  void (*findNewlines)(const char* base, const char* p, const char* end,
+                       std::vector<usize>* offsets);
+
+  // The name of the selected implementation ("avx2", "sse2" or "scalar").
+  const char* name;
+};
+
+// The best kernels for the running CPU.
+extern const ScanKernels kScanKernels;
+
+// The portable byte-at-a-time kernels, for comparison.
+extern const ScanKernels kScalarScanKernels;
+
+#ifdef FL_SCAN_X86
+// SSE2 is guaranteed by the build's target flags.
+extern const ScanKernels kSSE2ScanKernels;
+
+// Defined in scan_avx2.cpp, the only file compiled with -mavx2, so only use
+// them after checking the CPU supports AVX2. Anything that isn't a vector
+// loop is left to scan.cpp, so no inline function compiled for AVX2 (like a
+// std::vector member) can be the copy the linker keeps for other callers.
+extern const ScanKernels kAVX2ScanKernels;
+
+// Append `offset` plus the index of every set bit of `mask` to *offsets.
+void appendMaskOffsets(usize offset, u32 mask, std::vector<usize>* offsets);
+#endif
+
+} // namespace fl
+
+#endif /* SCAN_H_ */
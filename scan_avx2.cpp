@@ -0,0 +1,77 @@
+#include "scan.h"
+
+#ifdef FL_SCAN_X86
+#include <immintrin.h>
+
+namespace fl {
+
+// The AVX2 kernels are the SSE2 ones in scan.cpp with 32-byte vectors. The
+// build compiles this file alone with -mavx2, and kScanKernels only selects
+// them after checking the CPU supports it.
+
+namespace {
+
+inline __m256i whitespaceBytes256(__m256i v) {
+  return _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))),
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')),
+                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+}
+
+// See identifierBytes128.
+inline __m256i identifierBytes256(__m256i v) {
+  __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  __m256i alpha = _mm256_and_si256(
+      _mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+      _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+  __m256i digit = _mm256_and_si256(
+      _mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+      _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+  __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+  return _mm256_or_si256(_mm256_or_si256(alpha, digit), underscore);
+}
+
+const char* skipWhitespaceAVX2(const char* p, const char* end) {
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    u32 outside = ~static_cast<u32>(
+        _mm256_movemask_epi8(whitespaceBytes256(v)));
+    if (outside) { return p + __builtin_ctz(outside); }
+    p += 32;
+  }
+  return kSSE2ScanKernels.skipWhitespace(p, end);
+}
+
+const char* skipIdentifierCharsAVX2(const char* p, const char* end) {
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    u32 outside = ~static_cast<u32>(
+        _mm256_movemask_epi8(identifierBytes256(v)));
+    if (outside) { return p + __builtin_ctz(outside); }
+    p += 32;
+  }
+  return kSSE2ScanKernels.skipIdentifierChars(p, end);
+}
+
+void findNewlinesAVX2(const char* base, const char* p, const char* end,
+                      std::vector<usize>* offsets) {
+  const __m256i newline = _mm256_set1_epi8('\n');
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    u32 mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline));
+    if (mask) { appendMaskOffsets(p - base, mask, offsets); }
+    p += 32;
+  }
+  kSSE2ScanKernels.findNewlines(base, p, end, offsets);
+}
+
+} // namespace
+
+const ScanKernels kAVX2ScanKernels{
+  skipWhitespaceAVX2, skipIdentifierCharsAVX2, findNewlinesAVX2, "avx2"
+};
+
+} // namespace fl
+
+#endif // FL_SCAN_X86
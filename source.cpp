@@ -0,0 +1,249 @@
+#include "scan.h"
+#include "source.h"
+#include "stats.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+namespace fl {
+
+SourceFile::SourceFile(std::string filename, std::string contents,
+                       SourceLoc startLoc)
+    : filename(std::move(filename)),
+      source(""),
+      startLoc(startLoc),
+      ownedSource(std::move(contents)),
+      mapped(false),
+      streamed(false) {
+  source = ownedSource;
+}
+
+SourceFile::SourceFile(std::string filename, const char* mapping, usize size,
+                       SourceLoc startLoc)
+    : filename(std::move(filename)),
+      source(mapping, size),
+      startLoc(startLoc),
+      mapped(true),
+      streamed(false) {}
+
+SourceFile::SourceFile(std::string filename, SourceLoc startLoc)
+    : filename(std::move(filename)),
+      source(""),
+      startLoc(startLoc),
+      newlineOffsetsBuilt(true),
+      mapped(false),
+      streamed(true) {}
+
+SourceFile::~SourceFile() {
+  if (mapped) {
+    munmap(const_cast<char*>(source.data), source.length);
+  }
+}
+
+const std::vector<usize>& SourceFile::getNewlineOffsets() const {
+  if (!newlineOffsetsBuilt) {
+    const char* begin = source.data;
+    kScanKernels.findNewlines(begin, begin, begin + source.length,
+                              &lazyNewlineOffsets);
+    newlineOffsetsBuilt = true;
+  }
+  return lazyNewlineOffsets;
+}
+
+void SourceFile::appendStreamed(StringRef chunk) {
+  assert(streamed);
+  usize first = lazyNewlineOffsets.size();
+  kScanKernels.findNewlines(chunk.data, chunk.data, chunk.end(),
+                            &lazyNewlineOffsets);
+  for (usize i = first; i < lazyNewlineOffsets.size(); ++i) {
+    lazyNewlineOffsets[i] += streamedSize;
+  }
+  streamedSize += chunk.length;
+}
+
+SourceCoordinates SourceFile::findCoordinates(SourceLoc loc) const {
+  // The location may point just past the end for diagnostics at end of file.
+  usize offset = toOffset(loc);
+  const std::vector<usize>& newlineOffsets = getNewlineOffsets();
+  assert(std::is_sorted(newlineOffsets.begin(), newlineOffsets.end()));
+
+  // Find the first newline at or after the offset.
+  auto after = std::lower_bound(newlineOffsets.begin(), newlineOffsets.end(),
+                                offset);
+  usize newlineAfterIdx = after - newlineOffsets.begin();
+
+  usize line = newlineAfterIdx + 1;
+  usize column;
+
+  if (newlineAfterIdx == 0) {
+    column = offset + 1;
+  } else {
+    column = offset - newlineOffsets[newlineAfterIdx - 1];
+  }
+
+  return SourceCoordinates{line, column};
+}
+
+StringRef SourceFile::getLine(usize line) const {
+  assert(hasText());
+  const std::vector<usize>& newlineOffsets = getNewlineOffsets();
+  assert(line > 0 && line <= newlineOffsets.size() + 1);
+
+  // Index of the newline at the end of the line.
+  usize newlineAfterIdx = line - 1;
+
+  usize start;
+  if (newlineAfterIdx == 0) {
+    start = 0;
+  } else {
+    start = newlineOffsets[newlineAfterIdx - 1] + 1;
+  }
+
+  usize end;
+  if (newlineAfterIdx == newlineOffsets.size()) {
+    end = source.length;
+  } else {
+    end = newlineOffsets[newlineAfterIdx];
+  }
+
+  return StringRef{source.data + start, end - start};
+}
+
+bool SourceManager::reserveLocations(usize size, SourceLoc* startLoc) {
+  // Every file also gets a location for its end, and the next file starts
+  // after that so no location is shared between two files.
+  if (size >= UINT32_MAX - nextOffset) { return false; }
+
+  *startLoc = SourceLoc(nextOffset);
+  nextOffset += size + 1;
+  return true;
+}
+
+const SourceFile* SourceManager::addFile(std::string filename,
+                                        std::string source) {
+  SourceLoc startLoc;
+  if (!reserveLocations(source.size(), &startLoc)) { return nullptr; }
+
+  files.push_back(make_unique<SourceFile>(std::move(filename),
+                                          std::move(source), startLoc));
+  return files.back().get();
+}
+
+const SourceFile* SourceManager::loadFile(std::string filename,
+                                         std::string* error) {
+  PhaseTimer timer(kPhaseRead);
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    *error = std::strerror(errno);
+    return nullptr;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    *error = std::strerror(errno);
+    close(fd);
+    return nullptr;
+  }
+
+  // Pipes and other special files can't be mapped, and neither can empty
+  // files. Those are read into memory instead.
+  if (S_ISREG(info.st_mode) && info.st_size > 0) {
+    usize size = info.st_size;
+    SourceLoc startLoc;
+    if (!reserveLocations(size, &startLoc)) {
+      *error = "too much source code";
+      close(fd);
+      return nullptr;
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+      *error = std::strerror(errno);
+      return nullptr;
+    }
+
+    // The lexer reads the file front to back exactly once.
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    files.push_back(make_unique<SourceFile>(
+        std::move(filename), static_cast<const char*>(mapping), size,
+        startLoc));
+    return files.back().get();
+  }
+
+  std::string source;
+  char buffer[64 * 1024];
+  while (true) {
+    ssize_t count = read(fd, buffer, sizeof(buffer));
+    if (count == 0) { break; }
+    if (count < 0) {
+      if (errno == EINTR) { continue; }
+      *error = std::strerror(errno);
+      close(fd);
+      return nullptr;
+    }
+    source.append(buffer, count);
+  }
+  close(fd);
+
+  const SourceFile* file = addFile(std::move(filename), std::move(source));
+  if (!file) { *error = "too much source code"; }
+  return file;
+}
+
+SourceFile* SourceManager::addStreamedFile(std::string filename) {
+  SourceLoc startLoc;
+  if (!reserveLocations(UINT32_MAX - nextOffset - 1, &startLoc)) {
+    return nullptr;
+  }
+  files.push_back(make_unique<SourceFile>(std::move(filename), startLoc));
+  return files.back().get();
+}
+
+bool SourceStream::refill(usize keepFrom) {
+  assert(keepFrom >= windowStart && keepFrom <= windowStart + buffer.size());
+  buffer.erase(0, keepFrom - windowStart);
+  windowStart = keepFrom;
+  if (finished) { return false; }
+
+  usize oldSize = buffer.size();
+  buffer.resize(oldSize + kChunkSize);
+  ssize_t count;
+  do {
+    count = read(fd, &buffer[oldSize], kChunkSize);
+  } while (count < 0 && errno == EINTR);
+
+  if (count <= 0) {
+    if (count < 0) { error = std::strerror(errno); }
+    buffer.resize(oldSize);
+    finished = true;
+    return false;
+  }
+
+  buffer.resize(oldSize + count);
+  file->appendStreamed(StringRef{buffer.data() + oldSize,
+                                 static_cast<usize>(count)});
+  return true;
+}
+
+const SourceFile* SourceManager::getFile(SourceLoc loc) const {
+  // Find the last file starting at or before the location.
+  auto after = std::upper_bound(
+      files.begin(), files.end(), loc,
+      [](SourceLoc loc, const std::unique_ptr<SourceFile>& file) {
+        return loc < file->startLoc;
+      });
+  assert(after != files.begin() && "location before the first file");
+  const SourceFile* file = (after - 1)->get();
+  assert(file->contains(loc));
+  return file;
+}
+
+} // namespace fl
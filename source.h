@@ -0,0 +1,192 @@
+#ifndef SOURCE_H_
+#define SOURCE_H_
+
+#include "util.h"
+#include <cassert>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fl {
+
+// A position in the offset space of a SourceManager. Each file added to the
+// manager occupies its own range of offsets, so a single 32-bit offset
+// identifies both the file and the position within it.
+struct SourceLoc {
+  u32 offset = 0;
+
+  SourceLoc() {}
+  explicit SourceLoc(u32 offset) : offset(offset) {}
+
+  bool operator==(SourceLoc other) const { return offset == other.offset; }
+  bool operator!=(SourceLoc other) const { return offset != other.offset; }
+  bool operator<(SourceLoc other) const { return offset < other.offset; }
+};
+
+// A half-open range [start, end) of locations within one file.
+struct SourceRange {
+  SourceLoc start;
+  SourceLoc end;
+
+  SourceRange() {}
+  SourceRange(SourceLoc start, SourceLoc end) : start(start), end(end) {}
+};
+
+struct SourceCoordinates {
+  usize line;
+  usize column;
+};
+
+struct SourceFile {
+  std::string filename;
+
+  // The contents of the file: a view of either a string owned by the file or
+  // a read-only memory mapping of the file on disk.
+  StringRef source;
+
+  // The location of the first byte of the file. The file covers the locations
+  // from here to startLoc + source.length, inclusive, so the end of file has a
+  // location of its own.
+  SourceLoc startLoc;
+
+  SourceFile(std::string filename, std::string contents, SourceLoc startLoc);
+
+  // Take ownership of a memory mapping of `size` bytes.
+  SourceFile(std::string filename, const char* mapping, usize size,
+             SourceLoc startLoc);
+
+  // A file read incrementally by a SourceStream, which only keeps a window of
+  // the text in memory. The file itself keeps no text, just the newline
+  // offsets, so diagnostics in it can still give lines and columns.
+  SourceFile(std::string filename, SourceLoc startLoc);
+
+  ~SourceFile();
+
+  SourceFile(const SourceFile&) = delete;
+  SourceFile& operator=(const SourceFile&) = delete;
+
+  // The number of bytes in the file (so far, for a streamed file).
+  usize size() const { return streamed ? streamedSize : source.length; }
+
+  // Whether `source` holds the text of the file. Only streamed files don't.
+  bool hasText() const { return !streamed; }
+
+  bool contains(SourceLoc loc) const {
+    return startLoc.offset <= loc.offset &&
+        loc.offset - startLoc.offset <= size();
+  }
+
+  // Convert between locations and byte offsets within this file.
+  usize toOffset(SourceLoc loc) const {
+    assert(contains(loc));
+    return loc.offset - startLoc.offset;
+  }
+  SourceLoc toLoc(usize offset) const {
+    assert(offset <= size());
+    return SourceLoc(startLoc.offset + static_cast<u32>(offset));
+  }
+
+  StringRef getText(SourceRange range) const {
+    assert(hasText());
+    usize start = toOffset(range.start);
+    return StringRef{source.data + start, toOffset(range.end) - start};
+  }
+
+  SourceCoordinates findCoordinates(SourceLoc loc) const;
+  StringRef getLine(usize line) const;
+
+  // Record the next chunk of a streamed file.
+  void appendStreamed(StringRef chunk);
+
+ private:
+  // A list of the offsets of every newline in the source. It can be used to
+  // quickly find the line and column of the start and end of a SourceRange (by
+  // binary search) and to extract the text for a single line for diagnostic
+  // printouts. Only diagnostics need it, so it's built in one vectorized pass
+  // the first time it's used rather than during lexing. Not thread-safe.
+  mutable std::vector<usize> lazyNewlineOffsets;
+  mutable bool newlineOffsetsBuilt = false;
+
+  // Empty if the source is mapped or streamed.
+  std::string ownedSource;
+  bool mapped;
+  bool streamed;
+  usize streamedSize = 0;
+
+  const std::vector<usize>& getNewlineOffsets() const;
+};
+
+/*
+ * Reads a streamed SourceFile from a file descriptor (e.g. a pipe) chunk by
+ * chunk, so the lexer can start before the writer has finished and memory use
+ * stays bounded. Only a window of the text is kept: the bytes from the point
+ * the reader still needs onwards.
+ */
+struct SourceStream {
+  SourceFile* file;
+
+  // The file offset of window()[0].
+  usize windowStart = 0;
+
+  // Set once the end of the input has been read (or reading failed).
+  bool finished = false;
+
+  // Set if reading failed.
+  std::string error;
+
+  SourceStream(SourceFile* file, int fd) : file(file), fd(fd) {}
+
+  StringRef window() const { return buffer; }
+
+  // Drop the text before file offset `keepFrom` and read the next chunk onto
+  // the end of the window. Returns false, and sets `finished`, if the input
+  // has ended.
+  bool refill(usize keepFrom);
+
+ private:
+  static const usize kChunkSize = 64 * 1024;
+
+  int fd;
+  std::string buffer;
+};
+
+/*
+ * Owns every source file of a compilation and lays them out one after another
+ * in a single 32-bit offset space. Tokens, AST nodes and diagnostics only store
+ * compact SourceLocs; the file they belong to is looked up here when it's
+ * actually needed, e.g. to print a diagnostic.
+ */
+struct SourceManager {
+  // Add a file after all the others. Returns nullptr if the offset space is
+  // exhausted (more than 4 GiB of source in total).
+  const SourceFile* addFile(std::string filename, std::string source);
+
+  // Add the file at the given path. Regular files are mapped into memory
+  // rather than read, so they're never copied and only the pages the lexer
+  // has yet to reach need to be resident. Returns nullptr and sets *error if
+  // the file can't be read or doesn't fit.
+  const SourceFile* loadFile(std::string filename, std::string* error);
+
+  // Add a file to be read by a SourceStream. Its size isn't known up front, so
+  // it takes the rest of the offset space and must be the last file added.
+  SourceFile* addStreamedFile(std::string filename);
+
+  // The file containing the location.
+  const SourceFile* getFile(SourceLoc loc) const;
+
+  StringRef getText(SourceRange range) const {
+    return getFile(range.start)->getText(range);
+  }
+
+ private:
+  // Claim the locations for a file of `size` bytes, if there's room.
+  bool reserveLocations(usize size, SourceLoc* startLoc);
+
+  // Sorted by startLoc, since files are only ever appended.
+  std::vector<std::unique_ptr<SourceFile>> files;
+  u32 nextOffset = 0;
+};
+
+} // namespace fl
+
+#endif /* SOURCE_H_ */
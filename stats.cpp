@@ -0,0 +1,201 @@
+#include "ast.h"
+#include "stats.h"
+#include "trace.h"
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <cstdio>
+#include <ctime>
+
+namespace fl {
+
+const char* const kPhaseNames[kNumPhases] = {
+  "read", "lex", "parse", "resolve", "fold", "cache", "codegen", "verify",
+  "optimize", "emit"
+};
+
+const char* const kNodeKindNames[kNumNodeKinds] = {
+  "IntExpr", "VarExpr", "BinOpExpr", "CallExpr", "BlockExpr", "TypeName",
+  "UnitType", "ExternFunc", "FuncDef"
+};
+
+Stats compileStats;
+
+namespace {
+
+struct NodeCounter : public ast::ConstVisitor<NodeCounter> {
+  Stats* stats;
+
+  explicit NodeCounter(Stats* stats) : stats(stats) {}
+
+  void visitIntExpr(const ast::IntExpr*) {
+    ++stats->astNodes[kNodeIntExpr];
+  }
+
+  void visitVarExpr(const ast::VarExpr*) {
+    ++stats->astNodes[kNodeVarExpr];
+  }
+
+  void visitBinOpExpr(const ast::BinOpExpr*) {
+    ++stats->astNodes[kNodeBinOpExpr];
+  }
+
+  void visitCallExpr(const ast::CallExpr*) {
+    ++stats->astNodes[kNodeCallExpr];
+  }
+
+  void visitBlockExpr(const ast::BlockExpr*) {
+    ++stats->astNodes[kNodeBlockExpr];
+  }
+
+  void visitTypeName(const ast::TypeName*) {
+    ++stats->astNodes[kNodeTypeName];
+  }
+
+  void visitUnitType(const ast::UnitType*) {
+    ++stats->astNodes[kNodeUnitType];
+  }
+
+  void visitExternFunc(const ast::ExternFunc* fn) {
+    ++stats->astNodes[kNodeExternFunc];
+    visit(&fn->proto);
+  }
+
+  void visitFuncDef(const ast::FuncDef* fn) {
+    ++stats->astNodes[kNodeFuncDef];
+    visit(&fn->proto);
+    walkPreOrder(fn->body);
+  }
+
+  void visitFuncProto(const ast::FuncProto* proto) {
+    for (const ast::Type* type : proto->argTypes) { visit(type); }
+    visit(proto->returnType);
+  }
+};
+
+u64 readClock(clockid_t clock) {
+  timespec time;
+  clock_gettime(clock, &time);
+  return static_cast<u64>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+// The innermost running timer of the current thread.
+thread_local PhaseTimer* currentTimer = nullptr;
+
+double toMilliseconds(u64 nanos) {
+  return nanos / 1e6;
+}
+
+} // namespace
+
+void Stats::countModule(const ast::Module& module) {
+  NodeCounter counter(this);
+  for (const ast::Func* fn : module.functions) { counter.visit(fn); }
+  arenaBytes += module.arena->bytesAllocated();
+}
+
+void Stats::countInstructions(const llvm::Module& module) {
+  u64 count = 0;
+  for (const llvm::Function& fn : module) {
+    for (const llvm::BasicBlock& block : fn) { count += block.size(); }
+  }
+  llvmInstructions += count;
+}
+
+void Stats::print(std::ostream& o) const {
+  char line[80];
+  std::snprintf(line, sizeof(line), "%-12s %12s %12s\n",
+                "phase", "wall (ms)", "cpu (ms)");
+  o << line;
+
+  u64 totalWall = 0;
+  u64 totalCpu = 0;
+  for (usize i = 0; i < kNumPhases; ++i) {
+    totalWall += wallNanos[i];
+    totalCpu += cpuNanos[i];
+    std::snprintf(line, sizeof(line), "%-12s %12.3f %12.3f\n", kPhaseNames[i],
+                  toMilliseconds(wallNanos[i]), toMilliseconds(cpuNanos[i]));
+    o << line;
+  }
+  std::snprintf(line, sizeof(line), "%-12s %12.3f %12.3f\n", "total",
+                toMilliseconds(totalWall), toMilliseconds(totalCpu));
+  o << line;
+  o << "(times are summed over threads)\n\n";
+
+  u64 totalNodes = 0;
+  for (const auto& count : astNodes) { totalNodes += count; }
+
+  auto counter = [&](const char* name, u64 value) {
+    std::snprintf(line, sizeof(line), "%-20s %12llu\n", name,
+                  static_cast<unsigned long long>(value));
+    o << line;
+  };
+  counter("source bytes", sourceBytes);
+  counter("tokens", tokens);
+  counter("AST nodes", totalNodes);
+  for (usize i = 0; i < kNumNodeKinds; ++i) {
+    std::snprintf(line, sizeof(line), "  %-18s %12llu\n", kNodeKindNames[i],
+                  static_cast<unsigned long long>(astNodes[i]));
+    o << line;
+  }
+  counter("arena bytes", arenaBytes);
+  counter("LLVM instructions", llvmInstructions);
+  counter("cache hits", cacheHits);
+  counter("cache misses", cacheMisses);
+  counter("cache write failures", cacheWriteFailures);
+}
+
+void Stats::printJSON(std::ostream& o) const {
+  o << "{\n  \"phases\": {";
+  for (usize i = 0; i < kNumPhases; ++i) {
+    o << (i == 0 ? "\n" : ",\n") << "    \"" << kPhaseNames[i]
+        << "\": {\"wall_ns\": " << wallNanos[i]
+        << ", \"cpu_ns\": " << cpuNanos[i] << '}';
+  }
+  o << "\n  },\n  \"counters\": {\n"
+      << "    \"source_bytes\": " << sourceBytes << ",\n"
+      << "    \"tokens\": " << tokens << ",\n"
+      << "    \"ast_nodes\": {";
+  for (usize i = 0; i < kNumNodeKinds; ++i) {
+    o << (i == 0 ? "" : ", ") << '"' << kNodeKindNames[i] << "\": "
+        << astNodes[i];
+  }
+  o << "},\n"
+      << "    \"arena_bytes\": " << arenaBytes << ",\n"
+      << "    \"llvm_instructions\": " << llvmInstructions << ",\n"
+      << "    \"cache_hits\": " << cacheHits << ",\n"
+      << "    \"cache_misses\": " << cacheMisses << ",\n"
+      << "    \"cache_write_failures\": " << cacheWriteFailures << "\n"
+      << "  }\n}\n";
+}
+
+PhaseTimer::PhaseTimer(Phase phase)
+    : phase(phase), active(compileStats.enabled || compileTrace.enabled) {
+  if (!active) { return; }
+  outer = currentTimer;
+  currentTimer = this;
+  startWall = monotonicNanos();
+  startCpu = readClock(CLOCK_THREAD_CPUTIME_ID);
+}
+
+PhaseTimer::~PhaseTimer() {
+  if (!active) { return; }
+  u64 endWall = monotonicNanos();
+  u64 wall = endWall - startWall;
+  u64 cpu = readClock(CLOCK_THREAD_CPUTIME_ID) - startCpu;
+  if (compileTrace.enabled) {
+    compileTrace.record(kPhaseNames[phase], StringRef{"", 0}, startWall,
+                        endWall);
+  }
+  if (compileStats.enabled) {
+    compileStats.wallNanos[phase] += wall - nestedWall;
+    compileStats.cpuNanos[phase] += cpu - nestedCpu;
+  }
+
+  currentTimer = outer;
+  if (outer) {
+    outer->nestedWall += wall;
+    outer->nestedCpu += cpu;
+  }
+}
+
+} // namespace fl
@@ -0,0 +1,122 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include "util.h"
+#include <atomic>
+#include <iostream>
+
+namespace llvm {
+class Module;
+}
+
+namespace fl {
+
+namespace ast {
+struct Module;
+}
+
+// The phases of a compile, in the order they run.
+enum Phase {
+  kPhaseRead,
+  kPhaseLex,
+  kPhaseParse,
+  kPhaseResolve,
+  kPhaseFold,
+  kPhaseCache,
+  kPhaseCodegen,
+  kPhaseVerify,
+  kPhaseOptimize,
+  kPhaseEmit,
+
+  kNumPhases
+};
+
+extern const char* const kPhaseNames[kNumPhases];
+
+// The kinds of AST node counted separately in the statistics.
+enum NodeKind {
+  kNodeIntExpr,
+  kNodeVarExpr,
+  kNodeBinOpExpr,
+  kNodeCallExpr,
+  kNodeBlockExpr,
+  kNodeTypeName,
+  kNodeUnitType,
+  kNodeExternFunc,
+  kNodeFuncDef,
+
+  kNumNodeKinds
+};
+
+extern const char* const kNodeKindNames[kNumNodeKinds];
+
+/*
+ * Times and counters for the --stats report. Nothing is recorded unless
+ * `enabled` is set, which it is before any other thread starts, so when it's
+ * off each phase and counter costs one predictable branch. Phases may run on
+ * several threads at once, so everything is atomic.
+ */
+struct Stats {
+  bool enabled = false;
+
+  // Nanoseconds spent in each phase, summed over the threads that ran it.
+  // Nested phases are excluded from the enclosing one, so lexing up front
+  // isn't also counted as parsing.
+  std::atomic<u64> wallNanos[kNumPhases];
+  std::atomic<u64> cpuNanos[kNumPhases];
+
+  std::atomic<u64> sourceBytes;
+  std::atomic<u64> tokens;
+  std::atomic<u64> astNodes[kNumNodeKinds];
+  std::atomic<u64> arenaBytes;
+  std::atomic<u64> llvmInstructions;
+
+  // Function definitions whose optimized bitcode was found in the
+  // --cache-dir cache, those generated and added to it, and those of the
+  // latter that couldn't be written to it.
+  std::atomic<u64> cacheHits;
+  std::atomic<u64> cacheMisses;
+  std::atomic<u64> cacheWriteFailures;
+
+  // Count the nodes and arena memory of a parsed module.
+  void countModule(const ast::Module& module);
+
+  // Count the instructions in freshly generated (unoptimized) IR.
+  void countInstructions(const llvm::Module& module);
+
+  void print(std::ostream& o) const;
+  void printJSON(std::ostream& o) const;
+};
+
+// The statistics of this process's compile. As a global with static storage
+// duration, its atomics start out zero.
+extern Stats compileStats;
+
+/*
+ * Adds the wall and CPU time from its construction to its destruction to the
+ * given phase, if statistics are enabled, and records it as an event if
+ * tracing is. Timers nest within a thread: while an inner timer runs, the
+ * outer one is paused.
+ */
+struct PhaseTimer {
+  explicit PhaseTimer(Phase phase);
+  ~PhaseTimer();
+
+  PhaseTimer(const PhaseTimer&) = delete;
+  PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+ private:
+  Phase phase;
+  bool active;
+  PhaseTimer* outer;
+  u64 startWall;
+  u64 startCpu;
+
+  // Time spent in nested timers, to subtract from this one.
+  u64 nestedWall = 0;
+  u64 nestedCpu = 0;
+};
+
+} // namespace fl
+
+#endif /* STATS_H_ */
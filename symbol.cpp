@@ -0,0 +1,94 @@
+#include "arena.h"
+#include "symbol.h"
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+
+namespace fl {
+
+struct StringRefHash {
+  usize operator()(StringRef str) const {
+    // FNV-1a.
+    u64 hash = 14695981039346656037ull;
+    for (char c : str) {
+      hash = (hash ^ static_cast<u8>(c)) * 1099511628211ull;
+    }
+    return static_cast<usize>(hash);
+  }
+};
+
+// The process-wide table behind Symbol. The lexers of a parallel parse intern
+// concurrently, so interning is serialized by a mutex. Looking names up takes
+// no lock, since codegen threads do it for every function and argument: names
+// are stored in blocks that never move, and each is written before the count
+// that covers it is published.
+struct SymbolTable {
+  std::mutex mutex;
+
+  // Owns the characters of every interned name, and the blocks of names.
+  Arena arena;
+  std::unordered_map<StringRef, u32, StringRefHash> ids;
+
+  // Block k holds the 2^k names with ids from 2^k - 1 on, so the blocks
+  // double in size and 32 of them cover every id.
+  static const usize kNumBlocks = 32;
+  StringRef* blocks[kNumBlocks] = {};
+
+  // The number of names in the blocks. Stored with release semantics after
+  // a name is written and loaded with acquire semantics by lookups, so a
+  // lookup sees every name below the count it loads.
+  std::atomic<u32> count{0};
+
+  SymbolTable() {
+    // Reserve id 0 for the empty name so Symbol() is meaningful.
+    add(StringRef{"", 0});
+  }
+
+  static SymbolTable& global() {
+    static SymbolTable table;
+    return table;
+  }
+
+  StringRef& slot(u32 id) const {
+    u32 n = id + 1;
+    unsigned block = 31 - __builtin_clz(n);
+    return blocks[block][n - (1u << block)];
+  }
+
+  // Add a name with the next id, with the mutex held (or before any other
+  // thread can see the table).
+  u32 add(StringRef name) {
+    u32 id = count.load(std::memory_order_relaxed);
+    u32 n = id + 1;
+    if ((n & (n - 1)) == 0) {
+      unsigned block = 31 - __builtin_clz(n);
+      blocks[block] = static_cast<StringRef*>(arena.allocate(
+          sizeof(StringRef) << block, alignof(StringRef)));
+    }
+    new (&slot(id)) StringRef(name);
+    ids.emplace(name, id);
+    count.store(id + 1, std::memory_order_release);
+    return id;
+  }
+};
+
+Symbol Symbol::intern(StringRef name) {
+  SymbolTable& table = SymbolTable::global();
+  std::lock_guard<std::mutex> lock(table.mutex);
+
+  auto it = table.ids.find(name);
+  if (it != table.ids.end()) { return Symbol(it->second); }
+  return Symbol(table.add(table.arena.copyString(name)));
+}
+
+StringRef Symbol::str() const {
+  const SymbolTable& table = SymbolTable::global();
+  u32 count = table.count.load(std::memory_order_acquire);
+  assert(id < count && "symbol from another table");
+  (void) count;
+  return table.slot(id);
+}
+
+} // namespace fl
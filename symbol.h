@@ -0,0 +1,46 @@
+#ifndef SYMBOL_H_
+#define SYMBOL_H_
+
+#include "util.h"
+#include <functional>
+#include <iostream>
+
+namespace fl {
+
+/*
+ * An interned identifier. Every distinct name is mapped to a small integer by
+ * the global symbol table the first time it's seen, so symbols are cheap to
+ * copy, compare and hash. The default Symbol is the empty name.
+ */
+struct Symbol {
+  u32 id = 0;
+
+  Symbol() {}
+  explicit Symbol(u32 id) : id(id) {}
+
+  // Intern the name in the global SymbolTable.
+  static Symbol intern(StringRef name);
+
+  // The name this symbol was interned from.
+  StringRef str() const;
+
+  bool operator==(Symbol other) const { return id == other.id; }
+  bool operator!=(Symbol other) const { return id != other.id; }
+};
+
+inline std::ostream& operator<<(std::ostream& o, Symbol symbol) {
+  return o << symbol.str();
+}
+
+} // namespace fl
+
+namespace std {
+
+template<>
+struct hash<fl::Symbol> {
+  size_t operator()(fl::Symbol symbol) const { return symbol.id; }
+};
+
+} // namespace std
+
+#endif /* SYMBOL_H_ */
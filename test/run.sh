@@ -0,0 +1,182 @@
+#!/bin/sh
+# End-to-end tests of the fiddle binary, built and run with `scons test`, or
+# run by hand with `test/run.sh path/to/fiddle`. Each test_* function exits
+# nonzero (via check) on failure.
+
+fiddle=${1:-./fiddle}
+examples=$(dirname "$0")/../example
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+check() {
+  if ! "$@"; then
+    echo "check failed: $*" >&2
+    exit 1
+  fi
+}
+
+fails() {
+  ! "$@"
+}
+
+# Print `count` one-line functions, replacing those on the lines given as
+# "line=text;line=text".
+gen_functions() {
+  awk -v count="$1" -v replace="$2" 'BEGIN {
+    n = split(replace, pairs, ";")
+    for (i = 1; i <= n; ++i) {
+      split(pairs[i], pair, "=")
+      lines[pair[1]] = pair[2]
+    }
+    for (i = 1; i <= count; ++i) {
+      if (i in lines) { print lines[i] }
+      else { printf "fn f%d(x: i32) -> i32 { x * %d + 1 }\n", i, i }
+    }
+  }'
+}
+
+# Syntax errors in several top-level items, far enough apart to be parsed as
+# separate chunks with -j: only the first is reported, as without -j.
+test_parallel_parse_diagnostics() {
+  gen_functions 8000 \
+      '2000=fn bad1(x: i32) -> i32 { x + };6000=fn bad2(x: i32) -> i32 { ) }' \
+      > "$tmp/errors.fl"
+  for jobs in 1 4 16; do
+    check fails "$fiddle" -j$jobs -c -o "$tmp/errors.o" "$tmp/errors.fl" \
+        2> "$tmp/errors.j$jobs.txt"
+  done
+  check [ "$(grep -c 'error:' "$tmp/errors.j1.txt")" -eq 1 ]
+  check grep -q 'errors.fl:2000:' "$tmp/errors.j1.txt"
+  check cmp -s "$tmp/errors.j1.txt" "$tmp/errors.j4.txt"
+  check cmp -s "$tmp/errors.j1.txt" "$tmp/errors.j16.txt"
+}
+
+# A million levels of parentheses and of a left-nested operator chain get
+# through every pass without overflowing the native stack.
+test_deep_nesting() {
+  awk -v n=1000000 'BEGIN {
+    printf "fn deep(x: i32) -> i32 { "
+    for (i = 0; i < n; ++i) { printf "(" }
+    printf "x"
+    for (i = 0; i < n; ++i) { printf ")" }
+    for (i = 0; i < n; ++i) { printf " + x" }
+    print " }"
+    print "fn main() -> i32 { deep(1) }"
+  }' > "$tmp/deep.fl"
+  check "$fiddle" "$tmp/deep.fl" > /dev/null 2> "$tmp/deep.txt"
+  # The exit status is the low byte of 1 + 1000000.
+  status=0
+  "$fiddle" -O0 --run "$tmp/deep.fl" 2> "$tmp/deep.txt" || status=$?
+  check [ $status -eq 65 ]
+}
+
+# Two functions named foo are an error, pointing at both, the same with or
+# without the cache, where they would otherwise be compiled separately and
+# fail to link.
+test_duplicate_function() {
+  cat > "$tmp/dup.fl" <<'FL'
+fn foo() -> i32 { 1 }
+fn foo() -> i32 { 2 }
+fn main() -> i32 { foo() }
+FL
+  check fails "$fiddle" -c -o "$tmp/dup.o" "$tmp/dup.fl" 2> "$tmp/dup.txt"
+  check grep -q "dup.fl:2:1: error: redefinition of function 'foo'" \
+      "$tmp/dup.txt"
+  check grep -q "dup.fl:1:1: info: previous definition is here" \
+      "$tmp/dup.txt"
+  check fails "$fiddle" --cache-dir="$tmp/cache" -c -o "$tmp/dup.o" \
+      "$tmp/dup.fl" 2> "$tmp/dup.cached.txt"
+  check cmp -s "$tmp/dup.txt" "$tmp/dup.cached.txt"
+}
+
+# Calls are checked against the number of parameters.
+test_wrong_arity() {
+  cat > "$tmp/arity.fl" <<'FL'
+fn two(x: i32, y: i32) -> i32 { x + y }
+fn main() -> i32 { two(1) }
+FL
+  check fails "$fiddle" -c -o "$tmp/arity.o" "$tmp/arity.fl" \
+      2> "$tmp/arity.txt"
+  check grep -q "error: 'two' takes 2 arguments but is called with 1" \
+      "$tmp/arity.txt"
+}
+
+# Print the exit status of running a file's main at -O0.
+run_status() {
+  status=0
+  "$fiddle" -O0 --run "$1" > /dev/null || status=$?
+  echo $status
+}
+
+# Print the IR of function $2 in file $1 as codegen left it, after constant
+# folding but before any LLVM optimization.
+unoptimized_ir() {
+  "$fiddle" -O0 --print-ir -c -o "$tmp/ir.o" "$1" 2>&1 > /dev/null |
+    sed -n '/^; IR after/q; /^define .*@'"$2"'(/,/^}/p'
+}
+
+# Folding wraps like the i32 arithmetic it replaces.
+test_fold_wrapping() {
+  echo 'fn main() -> i32 { (2147483647 + 1) / 1073741824 }' > "$tmp/wrap.fl"
+  check [ "$(run_status "$tmp/wrap.fl")" -eq 254 ]
+  unoptimized_ir "$tmp/wrap.fl" main > "$tmp/wrap.ll"
+  check grep -q 'ret i32 -2$' "$tmp/wrap.ll"
+}
+
+# Divisions that trap at run time are left for codegen, not folded to a
+# number.
+test_fold_keeps_trapping_division() {
+  cat > "$tmp/div.fl" <<'FL'
+fn byZero() -> i32 { 7 / 0 }
+fn overflow() -> i32 { (0 - 2147483647 - 1) / (0 - 1) }
+fn main() -> i32 { 0 }
+FL
+  for fn in byZero overflow; do
+    unoptimized_ir "$tmp/div.fl" $fn > "$tmp/div.ll"
+    check grep -q '^define' "$tmp/div.ll"
+    check fails grep -q 'ret i32 -\{0,1\}[0-9]' "$tmp/div.ll"
+  done
+}
+
+# Multiplying by zero and dropping unused block expressions only remove code
+# without side effects.
+test_fold_side_effects() {
+  cat > "$tmp/pure.fl" <<'FL'
+extern fn putchar(c: i32) -> i32
+fn pure(x: i32) -> i32 { x + 1; x * 0 }
+fn impure() -> i32 { putchar(65) * 0 }
+fn main() -> i32 { putchar(66); impure() + pure(9) + 3 }
+FL
+  status=0
+  output=$("$fiddle" -O0 --run "$tmp/pure.fl") || status=$?
+  check [ "$output" = BA ]
+  check [ $status -eq 3 ]
+  unoptimized_ir "$tmp/pure.fl" pure > "$tmp/pure.ll"
+  check fails grep -q ' add ' "$tmp/pure.ll"
+  check grep -q 'ret i32 0$' "$tmp/pure.ll"
+  unoptimized_ir "$tmp/pure.fl" impure > "$tmp/impure.ll"
+  check grep -q 'call i32 @putchar(i32 65)' "$tmp/impure.ll"
+  check grep -q ' mul i32 ' "$tmp/impure.ll"
+}
+
+# A cache that can't be written to only costs a warning, and the entries it
+# couldn't write are counted.
+test_unwritable_cache() {
+  : > "$tmp/not-a-directory"
+  check "$fiddle" --cache-dir="$tmp/not-a-directory/cache" --stats=json \
+      -c -o "$tmp/fns.o" "$examples/multiple_fns.fl" 2> "$tmp/cache.txt"
+  check [ -s "$tmp/fns.o" ]
+  check grep -q '^warning: ' "$tmp/cache.txt"
+  check grep -q '"cache_write_failures": 5' "$tmp/cache.txt"
+}
+
+failures=0
+for test in $(sed -n 's/^\(test_[a-z_]*\)() {$/\1/p' "$0"); do
+  if (set -e; $test); then
+    echo "PASS $test"
+  else
+    echo "FAIL $test"
+    failures=$((failures + 1))
+  fi
+done
+[ $failures -eq 0 ]
@@ -1,62 +1,34 @@
 #ifndef TOKEN_H_
 #define TOKEN_H_
 
+#include "source.h"
+#include "symbol.h"
 #include "util.h"
-#include <memory>
-#include <string>
+#include <iostream>
 #include <vector>
 
 namespace fl {
 
-struct SourceCoordinates {
-  usize line;
-  usize column;
-};
-
-struct SourceFile {
-  std::string filename;
-  std::string source;
-
-  // A list of the offsets of every newline in the source, which is generated
-  // during lexing. It can be used to quickly find the line and column of the
-  // start and end of a SourceRange (by binary search) and to extract the text
-  // for a single line for diagnostic printouts.
-  std::vector<usize> newlineOffsets;
-
-  SourceFile(std::string filename, std::string source)
-      : filename(std::move(filename)),
-        source(std::move(source)) {}
-
-  SourceCoordinates findCoordinates(usize offset) const;
-  StringRef getLine(usize line) const;
-};
-
-struct SourceRange {
-  std::shared_ptr<SourceFile> file;
-  usize start;
-  usize end;
-
-  SourceCoordinates startCoordinates() const {
-    return file->findCoordinates(start);
-  }
-
-  StringRef text() const {
-    return StringRef{file->source.data() + start, end - start};
-  }
-};
-
-#define DEFINE_TOKEN_KINDS(X) \
+// Every token kind, with a description for diagnostics. Kinds listed with K
+// instead of X have a fixed multi-character spelling (keywords and special
+// operators) which the lexer recognizes with a perfect hash generated from
+// this list. Operators without a kind of their own are lexed as kOperator.
+#define DEFINE_TOKEN_KINDS(X, K) \
   X(kInvalid, "invalid token") \
   X(kEOF, "end of file") \
   X(kIdentifier, "identifier") \
   X(kInteger, "integer literal") \
   X(kOperator, "operator") \
-  X(kKeywordEnum, "keyword 'enum'") \
-  X(kKeywordExtern, "keyword 'extern'") \
-  X(kKeywordFn, "keyword 'fn'") \
-  X(kKeywordStruct, "keyword 'struct'") \
-  X(kArrowLeft, "'<-'") \
-  X(kArrowRight, "'->'") \
+  K(kKeywordEnum, "keyword 'enum'", "enum") \
+  K(kKeywordExtern, "keyword 'extern'", "extern") \
+  K(kKeywordFn, "keyword 'fn'", "fn") \
+  K(kKeywordStruct, "keyword 'struct'", "struct") \
+  K(kArrowLeft, "'<-'", "<-") \
+  K(kArrowRight, "'->'", "->") \
+  K(kPlus, "'+'", "+") \
+  K(kMinus, "'-'", "-") \
+  K(kStar, "'*'", "*") \
+  K(kSlash, "'/'", "/") \
   X(kParenLeft, "'('") \
   X(kParenRight, "')'") \
   X(kBraceLeft, "'{'") \
@@ -70,36 +42,106 @@ struct SourceRange {
 struct Token {
   enum TokenKind {
 #define X(name, description) name,
-    DEFINE_TOKEN_KINDS(X)
+#define K(name, description, spelling) name,
+    DEFINE_TOKEN_KINDS(X, K)
+#undef K
 #undef X
     kNumTokenKinds
   };
 
+  // Ordered to pack into 24 bytes, since tokens are copied around constantly.
+  // The text of a token is found through the SourceManager when it's needed.
   TokenKind kind;
+
+  // Only set for kIdentifier tokens.
+  Symbol symbol;
+
   SourceRange location;
 
   // Only set for kInteger tokens.
-  i64 intValue;
-
-  StringRef text() const { return location.text(); }
+  i64 intValue = 0;
 };
 
 const char* const kTokenKindNames[Token::kNumTokenKinds] = {
 #define X(name, description) #name,
-  DEFINE_TOKEN_KINDS(X)
+#define K(name, description, spelling) #name,
+  DEFINE_TOKEN_KINDS(X, K)
+#undef K
 #undef X
 };
 
 const char* const kTokenKindDescriptions[Token::kNumTokenKinds] = {
 #define X(name, description) description,
-  DEFINE_TOKEN_KINDS(X)
+#define K(name, description, spelling) description,
+  DEFINE_TOKEN_KINDS(X, K)
+#undef K
 #undef X
 };
 
-#undef DEFINE_TOKEN_KINDS
+// A sequence of tokens stored as parallel arrays rather than an array of
+// Tokens, so scanning the kinds ahead (the common case for lookahead) touches
+// one byte per token. Identifiers keep their Symbol id in `values`, integers
+// their value.
+struct TokenBuffer {
+  std::vector<u8> kinds;
+  std::vector<SourceRange> locations;
+  std::vector<i64> values;
+
+  // The index of the first token still held. Tokens are indexed from the
+  // start of the file even after earlier ones have been discarded.
+  usize firstIndex = 0;
+
+  // One past the index of the last token.
+  usize size() const { return firstIndex + kinds.size(); }
+
+  void reserve(usize count) {
+    kinds.reserve(count);
+    locations.reserve(count);
+    values.reserve(count);
+  }
+
+  void push(const Token& token) {
+    kinds.push_back(token.kind);
+    locations.push_back(token.location);
+    values.push_back(token.kind == Token::kIdentifier
+                     ? token.symbol.id : token.intValue);
+  }
+
+  Token::TokenKind kind(usize index) const {
+    return static_cast<Token::TokenKind>(kinds[index - firstIndex]);
+  }
+
+  SourceRange location(usize index) const {
+    return locations[index - firstIndex];
+  }
+
+  Token get(usize index) const {
+    Token token;
+    token.kind = kind(index);
+    token.location = location(index);
+    if (token.kind == Token::kIdentifier) {
+      token.symbol = Symbol(static_cast<u32>(values[index - firstIndex]));
+    } else {
+      token.intValue = values[index - firstIndex];
+    }
+    return token;
+  }
+
+  // Drop the tokens before `index`.
+  void discardBefore(usize index) {
+    assert(index >= firstIndex && index <= size());
+    usize count = index - firstIndex;
+    kinds.erase(kinds.begin(), kinds.begin() + count);
+    locations.erase(locations.begin(), locations.begin() + count);
+    values.erase(values.begin(), values.begin() + count);
+    firstIndex = index;
+  }
+};
 
-inline std::ostream& operator<<(std::ostream& o, const Token& token) {
-  return o << "Token(" << kTokenKindNames[token.kind] << ", \"" << token.text()
+// Print a token for debugging, given its text.
+inline std::ostream& printToken(std::ostream& o, const Token& token,
+                                StringRef text) {
+  return o << "Token(" << kTokenKindNames[token.kind] << ", \"" << text
       << "\")";
 }
 
@@ -0,0 +1,118 @@
+#include "trace.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+
+namespace fl {
+
+Tracer compileTrace;
+
+namespace {
+
+// Small sequential ids for threads, in the order they record their first
+// event, so the viewer lists the main thread first.
+std::atomic<u32> nextThreadId(0);
+thread_local u32 threadId = ~0u;
+
+u32 currentThreadId() {
+  if (threadId == ~0u) { threadId = nextThreadId++; }
+  return threadId;
+}
+
+void writeJSONString(std::ostream& o, StringRef str) {
+  o << '"';
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      o << '\\' << c;
+    } else if (static_cast<u8>(c) < 0x20) {
+      char escape[8];
+      std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+      o << escape;
+    } else {
+      o << c;
+    }
+  }
+  o << '"';
+}
+
+// Chrome trace timestamps are in microseconds, with fractions allowed.
+void writeMicroseconds(std::ostream& o, u64 nanos) {
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%.3f", nanos / 1e3);
+  o << buffer;
+}
+
+} // namespace
+
+u64 monotonicNanos() {
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return static_cast<u64>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+void Tracer::record(const char* name, StringRef detail, u64 startNanos,
+                    u64 endNanos) {
+  u64 duration = endNanos - startNanos;
+  if (duration < granularityNanos) { return; }
+  u32 thread = currentThreadId();
+  std::lock_guard<std::mutex> lock(mutex);
+  events.push_back(Event{name, detail.toString(), startNanos, duration,
+                         thread});
+}
+
+bool Tracer::write(const std::string& filename, std::string* error) {
+  std::ofstream out(filename);
+  if (!out) {
+    *error = std::strerror(errno);
+    return false;
+  }
+
+  // Make timestamps relative to the first event.
+  std::lock_guard<std::mutex> lock(mutex);
+  u64 origin = ~u64(0);
+  for (const auto& event : events) {
+    if (event.startNanos < origin) { origin = event.startNanos; }
+  }
+
+  out << "{\"traceEvents\": [";
+  for (usize i = 0; i < events.size(); ++i) {
+    const Event& event = events[i];
+    out << (i == 0 ? "\n" : ",\n") << "{\"ph\": \"X\", \"pid\": 1, \"tid\": "
+        << event.threadId << ", \"ts\": ";
+    writeMicroseconds(out, event.startNanos - origin);
+    out << ", \"dur\": ";
+    writeMicroseconds(out, event.durationNanos);
+    out << ", \"name\": ";
+    writeJSONString(out, event.name);
+    if (!event.detail.empty()) {
+      out << ", \"args\": {\"detail\": ";
+      writeJSONString(out, event.detail);
+      out << '}';
+    }
+    out << '}';
+  }
+  out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+
+  out.flush();
+  if (!out) {
+    *error = "failed to write the trace";
+    return false;
+  }
+  return true;
+}
+
+TraceScope::TraceScope(const char* name, StringRef detail)
+    : name(name), detail(detail), active(compileTrace.enabled) {
+  if (active) { startNanos = monotonicNanos(); }
+}
+
+TraceScope::~TraceScope() {
+  if (active) {
+    compileTrace.record(name, detail, startNanos, monotonicNanos());
+  }
+}
+
+} // namespace fl
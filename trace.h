@@ -0,0 +1,75 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "symbol.h"
+#include "util.h"
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fl {
+
+/*
+ * Records timed events for --time-trace, written out in the Chrome trace-event
+ * format that chrome://tracing and Perfetto display as a flame chart per
+ * thread. Events shorter than the granularity are dropped as they end, which
+ * keeps the file small when there are thousands of functions. Like
+ * compileStats, it's enabled before any other thread starts and costs a branch
+ * per event when off.
+ */
+struct Tracer {
+  bool enabled = false;
+  u64 granularityNanos = 500 * 1000;
+
+  // Record an event that ran on the calling thread from `startNanos` to
+  // `endNanos` on the monotonic clock (see monotonicNanos).
+  void record(const char* name, StringRef detail, u64 startNanos,
+              u64 endNanos);
+
+  // Write every recorded event to the file. Returns false and sets *error if
+  // it couldn't be written.
+  bool write(const std::string& filename, std::string* error);
+
+ private:
+  struct Event {
+    const char* name;
+    std::string detail;
+    u64 startNanos;
+    u64 durationNanos;
+    u32 threadId;
+  };
+
+  std::mutex mutex;
+  std::vector<Event> events;
+};
+
+extern Tracer compileTrace;
+
+// The current time of the monotonic clock, in nanoseconds.
+u64 monotonicNanos();
+
+// Records an event from its construction to its destruction, if tracing is
+// enabled. The name must be a string literal (or otherwise outlive the trace).
+struct TraceScope {
+  explicit TraceScope(const char* name, StringRef detail = StringRef{"", 0});
+  ~TraceScope();
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+  // Name what the event is about, e.g. a function known only once its
+  // prototype is parsed.
+  void setDetail(Symbol name) {
+    if (active) { detail = name.str(); }
+  }
+
+ private:
+  const char* name;
+  StringRef detail;
+  bool active;
+  u64 startNanos;
+};
+
+} // namespace fl
+
+#endif /* TRACE_H_ */
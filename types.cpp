@@ -1,15 +1,17 @@
 #include "types.h"
-#include <llvm/IR/Module.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <string>
+#include <utility>
 
 namespace fl {
 namespace type {
 
-llvm::Type* Int::llvmType(const llvm::Module* module) const {
-  return llvm::IntegerType::get(module->getContext(), bits);
+llvm::Type* Int::llvmType(llvm::LLVMContext& context) const {
+  return llvm::IntegerType::get(context, bits);
 }
 
-llvm::Type* Unit::llvmType(const llvm::Module* module) const {
-  return llvm::StructType::get(module->getContext(), false);
+llvm::Type* Unit::llvmType(llvm::LLVMContext& context) const {
+  return llvm::StructType::get(context, false);
 }
 
 void Int::dump(std::ostream& o) const {
@@ -20,5 +22,32 @@ void Unit::dump(std::ostream& o) const {
   o << "()";
 }
 
+TypeContext::TypeContext() {
+  unit = add<Unit>();
+  for (u32 bits : {8, 16, 32, 64}) {
+    names[Symbol::intern("i" + std::to_string(bits))] = intType(bits, true);
+  }
+}
+
+template<typename T, typename... Args>
+T* TypeContext::add(Args&&... args) {
+  auto type = make_unique<T>(std::forward<Args>(args)...);
+  type->id = types.size();
+  T* result = type.get();
+  types.push_back(std::move(type));
+  return result;
+}
+
+const Int* TypeContext::intType(u32 bits, bool signed_) {
+  const Int*& type = ints[bits << 1 | signed_];
+  if (!type) { type = add<Int>(bits, signed_); }
+  return type;
+}
+
+const Type* TypeContext::namedType(Symbol name) const {
+  auto it = names.find(name);
+  return it == names.end() ? nullptr : it->second;
+}
+
 } // namespace type
 } // namespace fl
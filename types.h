@@ -1,7 +1,9 @@
 #ifndef TYPES_H_
 #define TYPES_H_
 
+#include "symbol.h"
 #include "util.h"
+#include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Type.h>
 #include <iostream>
 #include <memory>
@@ -11,10 +13,18 @@
 namespace fl {
 namespace type {
 
-// Abstract base class for types.
+// Abstract base class for types. Types are only created by a TypeContext,
+// which makes each distinct type exactly once, so two types are equal if and
+// only if they're the same object.
 struct Type {
+  // The type's position in its TypeContext, for tables indexed by type.
+  u32 id = 0;
+
   virtual ~Type() {}
-  virtual llvm::Type* llvmType(const llvm::Module*) const = 0;
+
+  // Create the corresponding LLVM type. Use an LLVMTypeCache rather than
+  // calling this directly.
+  virtual llvm::Type* llvmType(llvm::LLVMContext& context) const = 0;
   virtual void dump(std::ostream& o = std::cerr) const = 0;
 };
 
@@ -28,16 +38,62 @@ struct Int : public Type {
   u32 bits;
   bool signed_;
   Int(u32 bits, bool signed_) : bits(bits), signed_(signed_) {}
-  llvm::Type* llvmType(const llvm::Module*) const override;
+  llvm::Type* llvmType(llvm::LLVMContext& context) const override;
   void dump(std::ostream& o = std::cerr) const override;
 };
 
 struct Unit : public Type {
   Unit() {}
-  llvm::Type* llvmType(const llvm::Module*) const override;
+  llvm::Type* llvmType(llvm::LLVMContext& context) const override;
   void dump(std::ostream& o = std::cerr) const override;
 };
 
+/*
+ * Owns and interns the types of a module. Asking for the same type twice
+ * returns the same pointer. Not thread-safe: types are created while
+ * resolving names, before codegen, which only reads them.
+ */
+struct TypeContext {
+  TypeContext();
+
+  TypeContext(const TypeContext&) = delete;
+  TypeContext& operator=(const TypeContext&) = delete;
+
+  const Int* intType(u32 bits, bool signed_);
+  const Unit* unitType() const { return unit; }
+
+  // The built-in type with the given name (i8, i16, i32 or i64), or null if
+  // there isn't one.
+  const Type* namedType(Symbol name) const;
+
+ private:
+  template<typename T, typename... Args>
+  T* add(Args&&... args);
+
+  std::vector<std::unique_ptr<Type>> types;
+  std::unordered_map<u32, const Int*> ints;
+  const Unit* unit;
+  std::unordered_map<Symbol, const Type*> names;
+};
+
+// The LLVM type of each type of a TypeContext in one LLVMContext, each
+// created the first time it's asked for. Parallel codegen partitions have
+// LLVMContexts (and so caches) of their own.
+struct LLVMTypeCache {
+  explicit LLVMTypeCache(llvm::LLVMContext& context) : context(context) {}
+
+  llvm::Type* get(const Type* type) {
+    if (type->id >= llvmTypes.size()) { llvmTypes.resize(type->id + 1); }
+    llvm::Type*& llvmType = llvmTypes[type->id];
+    if (!llvmType) { llvmType = type->llvmType(context); }
+    return llvmType;
+  }
+
+ private:
+  llvm::LLVMContext& context;
+  std::vector<llvm::Type*> llvmTypes;
+};
+
 } // namespace type
 } // namespace fl
 
@@ -64,6 +64,32 @@ inline std::ostream& operator<<(std::ostream& o, StringRef str) {
   return o.write(str.data, str.length);
 }
 
+/*
+ * A view into a contiguous array, like StringRef for arbitrary element types.
+ * Mostly used for arrays allocated in an Arena.
+ *
+ * Note that Slice doesn't own the elements it's viewing.
+ */
+template<typename T>
+struct Slice {
+  T* data;
+  usize length;
+
+  Slice() : data(nullptr), length(0) {}
+  Slice(T* data, usize length) : data(data), length(length) {}
+
+  usize size() const { return length; }
+  bool empty() const { return length == 0; }
+
+  T& operator[](usize i) const {
+    assert(i < length);
+    return data[i];
+  }
+
+  T* begin() const { return data; }
+  T* end() const { return data + length; }
+};
+
 template<typename T, typename... Args>
 std::unique_ptr<T> make_unique(Args&&... args) {
   return std::unique_ptr<T>(new T(std::forward<Args>(args)...));